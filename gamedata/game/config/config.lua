@@ -9,3 +9,13 @@ WrapLines = false
 FontSize = 40
 -- ONLY applies to the editor
 Syntax = true
+-- how long evaluating your code may take (in milliseconds) before it is stopped, 0 disables the limit
+EvalBudgetMs = 5000
+-- how many lua instructions evaluating your code may run before it is stopped, 0 disables the limit
+EvalBudgetInstructions = 0
+-- how the lua garbage collector runs while evaluating your code: "incremental", "generational"
+-- or "paused" (fastest, but all the garbage stays in memory until the evaluation ends)
+EvalGcMode = "generational"
+-- resolution of the 3D view while you move the camera, 1 is the full resolution and lower
+-- values make moving smoother on slow machines
+MovingRenderScale = 0.5
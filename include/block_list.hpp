@@ -0,0 +1,363 @@
+#ifndef BLOCK_LIST_HPP
+#define BLOCK_LIST_HPP
+
+#include "fenwick.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bed {
+/// Sequence stored as a list of blocks of at most MAX_BLOCK elements. Inserting or erasing
+/// only moves the elements of one block and the block list, not the whole tail of the
+/// sequence, and indexing finds the block through a Fenwick tree of the block sizes so it
+/// is O(log n).
+///
+/// When `Weight` is given, `Weight {}(element)` is the weight of an element and the sums of
+/// the weights are kept per block in a second Fenwick tree, so the weight of a prefix and
+/// the element at a given weight are found in O(log n + BLOCK) and stay up to date through
+/// inserts and erases. Elements whose weight changes have to be changed through update.
+template <typename T, typename Weight = void>
+class BlockList {
+public:
+    static constexpr const std::size_t BLOCK = 256;
+    static constexpr const std::size_t MAX_BLOCK = BLOCK * 2;
+    static constexpr const bool WEIGHTED = !std::is_void_v<Weight>;
+
+private:
+    struct NoWeight {
+        long operator()(const T&) const
+        {
+            return 0;
+        }
+    };
+    using weight_fn_t = std::conditional_t<WEIGHTED, Weight, NoWeight>;
+
+public:
+    using weight_t = std::invoke_result_t<weight_fn_t, const T&>;
+
+private:
+    struct Block {
+        std::vector<T> items {};
+        /// sum of the weights of `items`
+        weight_t weight {};
+    };
+    std::vector<Block> m_blocks {};
+    FenwickTree<std::size_t> m_block_sizes {};
+    FenwickTree<weight_t> m_block_weights {};
+    std::size_t m_size {};
+
+    static weight_t weigh(const T& value)
+    {
+        return weight_fn_t {}(value);
+    }
+    template <typename It>
+    static weight_t weigh(It first, It last)
+    {
+        weight_t ret {};
+        if constexpr (WEIGHTED) {
+            for (; first != last; ++first)
+                ret += weigh(*first);
+        }
+        return ret;
+    }
+    /// rebuilds the trees from the blocks, needed when the block count changed
+    void rebuild_sizes(void)
+    {
+        m_block_sizes.build(m_blocks.size(), [&](std::size_t b) { return m_blocks[b].items.size(); });
+        m_block_weights.build(m_blocks.size(), [&](std::size_t b) { return m_blocks[b].weight; });
+    }
+    void add_weight(std::size_t b, weight_t delta)
+    {
+        if constexpr (WEIGHTED) {
+            m_blocks[b].weight += delta;
+            m_block_weights.add(b, delta);
+        }
+    }
+    /// block of element `i` and the index of `i` within it, `i` == size() is the end of
+    /// the last block
+    std::pair<std::size_t, std::size_t> locate(std::size_t i) const
+    {
+        if (i >= m_size)
+            return { m_blocks.size() - 1, i - (m_size - m_blocks.back().items.size()) };
+        const auto b = m_block_sizes.upper_bound(i);
+        return { b, i - m_block_sizes.prefix_sum(b) };
+    }
+    /// splits block `b` into blocks of BLOCK elements when it grew past MAX_BLOCK. The block
+    /// indices after `b` shift so the trees are rebuilt, that is O(n / BLOCK) like inserting
+    /// into m_blocks and happens at most once every BLOCK inserts into the block
+    void split_block(std::size_t b)
+    {
+        auto& block = m_blocks[b];
+        if (block.items.size() <= MAX_BLOCK)
+            return;
+        std::vector<Block> pieces {};
+        for (std::size_t start = BLOCK; start < block.items.size(); start += BLOCK) {
+            const auto end = std::min(start + BLOCK, block.items.size());
+            auto& piece = pieces.emplace_back(std::vector<T>(std::make_move_iterator(block.items.begin() + start),
+                std::make_move_iterator(block.items.begin() + end)));
+            piece.weight = weigh(piece.items.begin(), piece.items.end());
+            block.weight -= piece.weight;
+        }
+        block.items.resize(BLOCK);
+        m_blocks.insert(m_blocks.begin() + b + 1,
+            std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+        rebuild_sizes();
+    }
+    /// merges the blocks `b` and `b` + 1 when one of them is empty or they fit in BLOCK
+    /// elements together, returns whether they were merged
+    bool merge_with_next(std::size_t b)
+    {
+        if (b + 1 >= m_blocks.size())
+            return false;
+        auto& block = m_blocks[b];
+        auto& next = m_blocks[b + 1];
+        if (!block.items.empty() && !next.items.empty() && block.items.size() + next.items.size() > BLOCK)
+            return false;
+        block.items.insert(block.items.end(),
+            std::make_move_iterator(next.items.begin()), std::make_move_iterator(next.items.end()));
+        block.weight += next.weight;
+        m_blocks.erase(m_blocks.begin() + b + 1);
+        return true;
+    }
+    /// merges block `b` with its neighbours, returns whether the block count changed
+    bool merge_block(std::size_t b)
+    {
+        bool merged = merge_with_next(b);
+        if (b > 0)
+            merged |= merge_with_next(b - 1);
+        return merged;
+    }
+
+public:
+    template <bool IS_CONST>
+    class basic_iterator {
+        using list_t = std::conditional_t<IS_CONST, const BlockList, BlockList>;
+        list_t* m_list = nullptr;
+        std::size_t m_block {};
+        std::size_t m_index {};
+        friend class BlockList;
+
+        basic_iterator(list_t* list, std::size_t block, std::size_t index)
+            : m_list(list)
+            , m_block(block)
+            , m_index(index)
+        {
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::conditional_t<IS_CONST, const T&, T&>;
+        using pointer = std::conditional_t<IS_CONST, const T*, T*>;
+
+        basic_iterator() = default;
+        reference operator*() const
+        {
+            return m_list->m_blocks[m_block].items[m_index];
+        }
+        pointer operator->() const
+        {
+            return &**this;
+        }
+        basic_iterator& operator++()
+        {
+            if (++m_index == m_list->m_blocks[m_block].items.size() && m_block + 1 < m_list->m_blocks.size()) {
+                m_block++;
+                m_index = 0;
+            }
+            return *this;
+        }
+        basic_iterator operator++(int)
+        {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(const basic_iterator& other) const
+        {
+            return m_block == other.m_block && m_index == other.m_index;
+        }
+    };
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    BlockList()
+    {
+        clear();
+    }
+    BlockList(std::initializer_list<T> values)
+    {
+        clear();
+        insert(0, values.begin(), values.end());
+    }
+    std::size_t size(void) const
+    {
+        return m_size;
+    }
+    bool empty(void) const
+    {
+        return m_size == 0;
+    }
+    T& operator[](std::size_t i)
+    {
+        const auto [b, j] = locate(i);
+        return m_blocks[b].items[j];
+    }
+    const T& operator[](std::size_t i) const
+    {
+        const auto [b, j] = locate(i);
+        return m_blocks[b].items[j];
+    }
+    T& back(void)
+    {
+        return m_blocks.back().items.back();
+    }
+    const T& back(void) const
+    {
+        return m_blocks.back().items.back();
+    }
+    iterator begin(void)
+    {
+        return { this, 0, 0 };
+    }
+    iterator end(void)
+    {
+        return { this, m_blocks.size() - 1, m_blocks.back().items.size() };
+    }
+    const_iterator begin(void) const
+    {
+        return { this, 0, 0 };
+    }
+    const_iterator end(void) const
+    {
+        return { this, m_blocks.size() - 1, m_blocks.back().items.size() };
+    }
+    void clear(void)
+    {
+        // there always is one block, even when it is empty
+        m_blocks.assign(1, {});
+        m_size = 0;
+        rebuild_sizes();
+    }
+    void push_back(T value)
+    {
+        insert(m_size, std::move(value));
+    }
+    /// inserts `value` before element `i`
+    void insert(std::size_t i, T value)
+    {
+        assert(i <= m_size);
+        const auto [b, j] = locate(i);
+        const auto weight = weigh(value);
+        m_blocks[b].items.insert(m_blocks[b].items.begin() + j, std::move(value));
+        m_size++;
+        m_block_sizes.add(b, 1);
+        add_weight(b, weight);
+        split_block(b);
+    }
+    /// inserts [first, last) before element `i`
+    template <typename It>
+    void insert(std::size_t i, It first, It last)
+    {
+        assert(i <= m_size);
+        const auto [b, j] = locate(i);
+        auto& items = m_blocks[b].items;
+        const auto count = items.size();
+        items.insert(items.begin() + j, first, last);
+        const auto inserted = items.size() - count;
+        m_size += inserted;
+        m_block_sizes.add(b, inserted);
+        add_weight(b, weigh(items.begin() + j, items.begin() + j + inserted));
+        split_block(b);
+    }
+    /// erases the elements [first, last), only the blocks the range touches are merged with
+    /// their neighbours and the trees are rebuilt only when the block count changed
+    void erase(std::size_t first, std::size_t last)
+    {
+        assert(first <= last && last <= m_size);
+        if (first == last)
+            return;
+        const auto [b, j] = locate(first);
+        const auto [e, k] = locate(last);
+        m_size -= last - first;
+        bool count_changed = false;
+        auto& items = m_blocks[b].items;
+        if (b == e) {
+            add_weight(b, -weigh(items.begin() + j, items.begin() + k));
+            items.erase(items.begin() + j, items.begin() + k);
+            m_block_sizes.add(b, j - k);
+        } else {
+            // the tail of the first block, the blocks in between and the head of the last one
+            auto& last_items = m_blocks[e].items;
+            add_weight(b, -weigh(items.begin() + j, items.end()));
+            add_weight(e, -weigh(last_items.begin(), last_items.begin() + k));
+            m_block_sizes.add(b, j - items.size());
+            m_block_sizes.add(e, -k);
+            items.erase(items.begin() + j, items.end());
+            last_items.erase(last_items.begin(), last_items.begin() + k);
+            if (e > b + 1) {
+                m_blocks.erase(m_blocks.begin() + b + 1, m_blocks.begin() + e);
+                count_changed = true;
+            }
+            count_changed |= merge_block(b + 1);
+        }
+        count_changed |= merge_block(b);
+        if (count_changed)
+            rebuild_sizes();
+    }
+    /// calls `fn` with element `i` and updates the weights with the new weight of the element
+    template <typename F>
+    void update(std::size_t i, F&& fn)
+    {
+        const auto [b, j] = locate(i);
+        auto& value = m_blocks[b].items[j];
+        const auto old_weight = weigh(value);
+        fn(value);
+        add_weight(b, weigh(value) - old_weight);
+    }
+    /// recomputes every weight, after the elements were changed in place without update
+    void reweigh(void)
+    {
+        if constexpr (WEIGHTED) {
+            for (auto& block : m_blocks)
+                block.weight = weigh(block.items.begin(), block.items.end());
+            m_block_weights.build(m_blocks.size(), [&](std::size_t b) { return m_blocks[b].weight; });
+        }
+    }
+    weight_t total_weight(void) const
+    {
+        return m_block_weights.total();
+    }
+    /// sum of the weights of the first `n` elements
+    weight_t prefix_weight(std::size_t n) const
+    {
+        const auto [b, j] = locate(n);
+        const auto& items = m_blocks[b].items;
+        return m_block_weights.prefix_sum(b) + weigh(items.begin(), items.begin() + j);
+    }
+    /// the largest n for which prefix_weight(n) <= value, like FenwickTree::upper_bound.
+    /// Elements weighing 0 are skipped
+    std::size_t upper_bound_weight(weight_t value) const
+    {
+        const auto b = m_block_weights.upper_bound(value);
+        if (b >= m_blocks.size())
+            return m_size;
+        value -= m_block_weights.prefix_sum(b);
+        const auto& items = m_blocks[b].items;
+        std::size_t j = 0;
+        while (j < items.size() && weigh(items[j]) <= value) {
+            value -= weigh(items[j]);
+            j++;
+        }
+        return m_block_sizes.prefix_sum(b) + j;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef BOOT_CENSUS_HPP
+#define BOOT_CENSUS_HPP
+#include "bootleg/cube_data.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+namespace boot {
+
+/// Result of comparing a cube against the solution of a level, voxel by voxel
+struct CubeCensus {
+    using brick_mask_t = std::array<uint64_t, CubeData::BRICK_VOLUME / 64>;
+    /// every voxel matches the solution
+    bool completed = false;
+    size_t mismatches {};
+    /// one bit per voxel for every brick of the cube, in the layout order of CubeData,
+    /// set when the voxel differs. Bricks without mismatches have no mask.
+    std::vector<std::unique_ptr<brick_mask_t>> brick_mismatches {};
+    /// mismatches in every y layer
+    std::vector<size_t> layer_mismatches {};
+    inline bool is_mismatch(const CubeData& cube, int x, int y, int z) const
+    {
+        const auto& mask = brick_mismatches[cube.brick_index(x, y, z)];
+        if (!mask)
+            return false;
+        const size_t idx = CubeData::local_index(x, y, z);
+        return ((*mask)[idx / 64] >> (idx % 64)) & 1;
+    }
+    inline bool brick_has_mismatches(size_t b) const
+    {
+        return brick_mismatches[b] != nullptr;
+    }
+};
+
+/// compares the packed colors of both cubes (SSE2/AVX2 when available), the cubes must
+/// have the same dimensions. Bricks that are empty in both cubes are skipped.
+CubeCensus take_census(const CubeData& cube, const CubeData& solution);
+}
+#endif
@@ -0,0 +1,118 @@
+#ifndef BOOT_CUBE_DATA_HPP
+#define BOOT_CUBE_DATA_HPP
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <raylib.h>
+#include <span>
+namespace boot {
+
+/// Voxel colors stored sparsely in bricks of 16x16x16 packed 32-bit RGBA values (the byte
+/// layout of raylib's Color). A brick that only holds BLANK is not allocated at all, so
+/// memory grows with the occupied volume and not with the dimensions of the cube.
+/// Bricks are ordered x-major: brick (bx, by, bz) has index (bx * BY + by) * BZ + bz, the
+/// voxels inside a brick use the same order. `set` may be called concurrently for different
+/// voxels, everything else needs exclusive access.
+struct CubeData {
+    static constexpr const int BRICK_EDGE = 16;
+    static constexpr const size_t BRICK_VOLUME = BRICK_EDGE * BRICK_EDGE * BRICK_EDGE;
+    using brick_t = std::array<uint32_t, BRICK_VOLUME>;
+    struct BrickOrigin {
+        int x {}, y {}, z {};
+    };
+
+    int x {}, y {}, z {};
+
+private:
+    int m_bx {}, m_by {}, m_bz {};
+    size_t m_brick_count {};
+    std::unique_ptr<std::atomic<brick_t*>[]> m_bricks {};
+
+public:
+    CubeData(int x, int y, int z);
+    CubeData();
+    CubeData(const CubeData& other);
+    CubeData(CubeData&& other) noexcept;
+    CubeData& operator=(const CubeData& other);
+    CubeData& operator=(CubeData&& other) noexcept;
+    ~CubeData();
+
+    inline static uint32_t pack(Color c)
+    {
+        return std::bit_cast<uint32_t>(c);
+    }
+    inline static Color unpack(uint32_t c)
+    {
+        return std::bit_cast<Color>(c);
+    }
+    inline size_t brick_index(int x, int y, int z) const
+    {
+        return (static_cast<size_t>(x / BRICK_EDGE) * m_by + y / BRICK_EDGE) * m_bz + z / BRICK_EDGE;
+    }
+    inline static size_t local_index(int x, int y, int z)
+    {
+        return (static_cast<size_t>(x % BRICK_EDGE) * BRICK_EDGE + y % BRICK_EDGE) * BRICK_EDGE
+            + z % BRICK_EDGE;
+    }
+    inline uint32_t get_packed(int x, int y, int z) const
+    {
+        const auto* brick = m_bricks[brick_index(x, y, z)].load(std::memory_order_relaxed);
+        return brick ? (*brick)[local_index(x, y, z)] : 0;
+    }
+    inline Color get(int x, int y, int z) const
+    {
+        return unpack(get_packed(x, y, z));
+    }
+    inline void set_packed(int x, int y, int z, uint32_t c)
+    {
+        const size_t b = brick_index(x, y, z);
+        auto* brick = m_bricks[b].load(std::memory_order_acquire);
+        if (!brick) {
+            // writing BLANK into an empty brick changes nothing
+            if (c == 0)
+                return;
+            brick = allocate_brick(b);
+        }
+        (*brick)[local_index(x, y, z)] = c;
+    }
+    inline void set(int x, int y, int z, Color c)
+    {
+        set_packed(x, y, z, pack(c));
+    }
+    inline size_t brick_count(void) const
+    {
+        return m_brick_count;
+    }
+    inline bool has_brick(size_t b) const
+    {
+        return m_bricks[b].load(std::memory_order_relaxed) != nullptr;
+    }
+    /// the voxels of an allocated brick, empty for a brick that only holds BLANK
+    inline std::span<const uint32_t> brick(size_t b) const
+    {
+        const auto* brick = m_bricks[b].load(std::memory_order_relaxed);
+        return brick ? std::span<const uint32_t>(*brick) : std::span<const uint32_t> {};
+    }
+    BrickOrigin brick_origin(size_t b) const;
+    /// number of allocated bricks
+    size_t occupied_bricks(void) const;
+    inline bool same_dims(const CubeData& other) const
+    {
+        return x == other.x && y == other.y && z == other.z;
+    }
+    /// copies the colors of `other`, reusing the allocated bricks when the dimensions match
+    void copy_from(const CubeData& other);
+    /// frees the bricks that only hold BLANK
+    void compact(void);
+    bool operator==(const CubeData& other) const;
+
+private:
+    brick_t* allocate_brick(size_t b);
+    void free_bricks(void);
+};
+static_assert(sizeof(Color) == sizeof(uint32_t));
+}
+#endif
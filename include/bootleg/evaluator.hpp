@@ -0,0 +1,212 @@
+#ifndef BOOT_EVALUATOR_HPP
+#define BOOT_EVALUATOR_HPP
+#include "bootleg/lua_generics.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifdef __cplusplus
+extern "C" {
+#include <lua.h>
+}
+#endif
+namespace boot {
+struct CubeData;
+
+/// allocation counters of a lua state
+struct LuaAllocStats {
+    uint64_t allocations {};
+    uint64_t reallocations {};
+    uint64_t frees {};
+    /// allocations served from the free lists of the pool
+    uint64_t pool_hits {};
+    size_t bytes_in_use {};
+    size_t peak_bytes {};
+    /// memory reserved by the pool chunks
+    size_t pool_bytes {};
+    LuaAllocStats& operator+=(const LuaAllocStats& other);
+};
+
+/// A lua_Alloc that serves small blocks from size classes carved out of big chunks, freed
+/// blocks go to the free list of their class and get reused instead of going back to the
+/// system. Blocks bigger than MAX_POOLED use the system allocator. Not thread safe, every
+/// lua state gets its own allocator.
+class LuaPoolAllocator {
+public:
+    static constexpr const size_t GRANULE = 16;
+    static constexpr const size_t MAX_POOLED = 256;
+    /// chunks are aligned to their size so the chunk of a block is found by masking its address
+    static constexpr const size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    /// at the start of every chunk, takes one granule so the blocks stay aligned
+    struct ChunkHeader {
+        /// blocks of the chunk that are in use
+        size_t live {};
+    };
+    struct ChunkDeleter {
+        void operator()(std::byte* chunk) const;
+    };
+    std::array<FreeBlock*, MAX_POOLED / GRANULE> m_free_lists {};
+    std::vector<std::unique_ptr<std::byte[], ChunkDeleter>> m_chunks {};
+    std::byte* m_cursor {};
+    std::byte* m_chunk_end {};
+    LuaAllocStats m_stats {};
+
+public:
+    LuaPoolAllocator() = default;
+    LuaPoolAllocator(const LuaPoolAllocator&) = delete;
+    LuaPoolAllocator& operator=(const LuaPoolAllocator&) = delete;
+    /// the lua_Alloc, `ud` has to point at a LuaPoolAllocator
+    static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+    const LuaAllocStats& get_stats(void) const;
+    /// zeroes the counters, the bytes in use and reserved by the pool stay
+    void reset_stats(void);
+    /// gives the chunks that have no block in use back to the system and drops their blocks
+    /// from the free lists, returns the number of bytes released. The chunks cannot simply be
+    /// rewound since the lua state that uses the allocator keeps living between evaluations
+    size_t trim(void);
+
+private:
+    static ChunkHeader* chunk_of(const void* block);
+    void* reallocate(void* ptr, size_t osize, size_t nsize);
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size);
+};
+
+/// how the garbage collector of an evaluation state runs during the voxel sweep
+enum struct LuaGcMode {
+    Incremental,
+    Generational,
+    /// stopped for the whole sweep and run once at the end
+    Paused,
+};
+
+/// creates a new lua state with the game globals (colors, `color.fromRGB`, x, y, z...)
+/// and with the unsafe standard libraries removed
+lua_State* new_sandboxed_lua_state(void);
+/// same as above, with a custom allocator
+lua_State* new_sandboxed_lua_state(lua_Alloc alloc, void* ud);
+
+/// A lua state that is created once and then reused. Scripts run with an environment table
+/// as their _ENV, the table falls back to the sandboxed globals so resetting the sandbox only
+/// has to clear what the scripts stored in it instead of building a new interpreter. The
+/// globals and the library tables (`math`, `color`...) are shared between runs, resetting
+/// puts back their original contents and metatables from copies taken at creation.
+class LuaSandbox {
+    LuaPoolAllocator m_allocator {};
+    lua_State* m_L {};
+    int m_env_ref = LUA_NOREF;
+    int m_env_meta_ref = LUA_NOREF;
+    /// maps every shared table to a copy of its original contents
+    int m_shared_ref = LUA_NOREF;
+
+public:
+    LuaSandbox();
+    LuaSandbox(const LuaSandbox&) = delete;
+    LuaSandbox& operator=(const LuaSandbox&) = delete;
+    ~LuaSandbox();
+    lua_State* get_state(void) const;
+    /// clears the environment and the stack and restores the shared tables, then collects the
+    /// garbage of the previous run and trims the allocator. Returns how many entries of the
+    /// environment were cleared
+    size_t reset(void);
+    /// loads a chunk that runs in the environment and leaves it on the stack,
+    /// returns the status of luaL_loadbuffer
+    int load(std::string_view source, const char* chunk_name);
+    /// loads and runs a chunk in the environment, returns the error message if it fails
+    std::optional<std::string> run(std::string_view source, const char* chunk_name);
+    const LuaAllocStats& get_alloc_stats(void) const;
+    void reset_alloc_stats(void);
+    /// reads a variable like lua::getglobalv does, looking in the environment first
+    template <typename T>
+    inline std::optional<T> get(const char* name)
+    {
+        lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_env_ref);
+        lua_getfield(m_L, -1, name);
+        return lua::genericget<T>(m_L);
+    }
+};
+
+/// wraps the player's code into a chunk that returns the voxel function, x, y, z, X, Y, Z
+/// and Color become locals of the chunk so the code keeps referring to them the same way
+std::string wrap_player_source(std::string_view source);
+/// wraps a level script into a chunk that runs it once and returns a voxel function
+/// calling its `Generate`
+std::string wrap_level_source(std::string_view source);
+
+/// Evaluates a lua script for every voxel of a cube, the cube is split into slabs along
+/// the x axis and each slab is evaluated on its own thread with its own lua sandbox. The
+/// worker threads are started once and wait for the slabs of the next evaluation, only one
+/// evaluation can run at a time.
+class VoxelEvaluator {
+public:
+    struct Job {
+        /// a chunk returning the voxel function `f(x, y, z, X, Y, Z) -> color`,
+        /// see wrap_player_source and wrap_level_source
+        std::string_view source {};
+        /// chunk name passed to luaL_loadbuffer, used in error messages
+        const char* chunk_name {};
+        /// incremented with the number of evaluated voxels as the evaluation goes on
+        std::atomic<size_t>* progress {};
+        /// when a stop is requested the evaluation is interrupted, even in the middle of a voxel
+        std::stop_token stop {};
+        /// maximum number of lua instructions for the whole evaluation, 0 means no limit
+        uint64_t instruction_budget {};
+        /// maximum wall-clock time for the whole evaluation, 0 means no limit
+        std::chrono::milliseconds time_budget {};
+        LuaGcMode gc_mode = LuaGcMode::Incremental;
+        /// when set a failing voxel does not stop the evaluation, the error is passed to it
+        /// instead and the voxel keeps the Color the script had set before the error. Called
+        /// from the worker threads
+        std::function<void(std::string_view error)> voxel_error {};
+    };
+
+private:
+    std::vector<std::unique_ptr<LuaSandbox>> m_sandboxes {};
+    size_t m_worker_count {};
+    /// evaluates one slab of the current evaluation, set by evaluate for its duration
+    std::function<void(size_t)> m_slab_task {};
+    size_t m_slab_count {};
+    /// incremented by every evaluation to wake the workers up
+    uint64_t m_generation {};
+    /// workers that have not finished their slab of the current evaluation yet
+    size_t m_pending {};
+    std::mutex m_mutex {};
+    std::condition_variable_any m_work_ready {};
+    std::condition_variable m_work_done {};
+    /// worker `i` evaluates slab `i` + 1 in its own sandbox, the calling thread takes slab 0.
+    /// Declared last so the workers are stopped and joined before the rest is destroyed
+    std::vector<std::jthread> m_workers {};
+
+    void worker_loop(std::stop_token stop, size_t slab, uint64_t generation);
+
+public:
+    explicit VoxelEvaluator(size_t worker_count = 0);
+    VoxelEvaluator(const VoxelEvaluator&) = delete;
+    VoxelEvaluator& operator=(const VoxelEvaluator&) = delete;
+    ~VoxelEvaluator() = default;
+    /// writes the evaluated colors directly into `out`, returns the error of the first
+    /// failing voxel (in x, y, z order) if any. After an error the voxels that come after the
+    /// failing one may or may not have been written depending on the timing of the slabs
+    std::optional<std::string> evaluate(const Job& job, CubeData& out);
+    size_t get_worker_count(void) const;
+    /// allocation counters of all the worker states since the start of the last evaluation
+    LuaAllocStats get_alloc_stats(void) const;
+};
+}
+#endif
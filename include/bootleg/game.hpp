@@ -1,13 +1,20 @@
 #ifndef BOOT_GAME_HPP
 #define BOOT_GAME_HPP
+#include "bootleg/census.hpp"
+#include "bootleg/cube_data.hpp"
+#include "bootleg/evaluator.hpp"
 #include "bootleg/slider.hpp"
+#include "bootleg/voxel_renderer.hpp"
+#include <array>
 #include <buffer.hpp>
 #include <cstddef>
 #include <cstring>
+#include <limits>
 #include <format>
 #include <string_view>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
 #ifdef __cplusplus
 extern "C" {
 #include <lauxlib.h>
@@ -16,7 +23,9 @@ extern "C" {
 }
 #endif
 #include "meu3.h"
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <raylib.h>
 #include <vector>
 
@@ -77,8 +86,9 @@ namespace path {
 }
 Color decode_color_from_hex(unsigned int hex_color);
 using buffer_t = bed::TextBuffer;
-void markdown_like_syntax_parser(Color foreground,
+buffer_t::syntax_state_t markdown_like_syntax_parser(Color foreground,
     buffer_t::syntax_data_t& syntax,
+    buffer_t::syntax_state_t state,
     buffer_t::text_buffer_iterator tit,
     const buffer_t::text_buffer_iterator end);
 void draw_cursor_tooltip(const char* txt, Font font, float font_sz, float spacing, const Rectangle& bounds, Color color);
@@ -121,6 +131,68 @@ Vector2 draw_codepoint_3d(int codepoint, Font font, const Vector3& pos,
     float font_size, const Color& color,
     bool backface = false, const Rotation& rotation = Rotation::none());
 
+/// Collects 3D text of one font as glyph quads that are already transformed on the CPU.
+/// `flush` draws all of them with a single texture bind as one vertex stream, so many
+/// strings cost about as much as one.
+class TextBatch3D {
+public:
+    /// corners in the order top left, bottom left, bottom right, top right
+    struct Quad {
+        Vector3 corners[4] {};
+        Vector2 texcoords[4] {};
+        Color color {};
+    };
+
+private:
+    Font m_font {};
+    std::vector<Quad> m_quads {};
+
+public:
+    TextBatch3D() = default;
+    explicit TextBatch3D(Font font);
+    /// also drops everything added so far
+    void set_font(Font font);
+    Font get_font(void) const;
+    /// same placement as `draw_codepoint_3d`, returns the size of the glyph
+    Vector2 add_codepoint(int codepoint, Vector3 pos, float font_size, const Color& color,
+        bool backface = false, const Rotation& rotation = Rotation::none());
+    Vector2 add_codepoint(int codepoint, Vector3 pos, float font_size, const Color& color,
+        bool backface, const Matrix& rotation);
+    /// same placement as `draw_text_3d`
+    void add_text(const char* txt, Vector3 pos, float font_size, float spacing,
+        const Color& color, bool backface = false, const Rotation& rotation = Rotation::none());
+    const std::vector<Quad>& get_quads(void) const;
+    void clear(void);
+    /// draws and drops every quad added since the last flush, call between BeginMode3D and
+    /// EndMode3D
+    void flush(void);
+};
+
+/// 3D text of one font baked into a single mesh that draws in one call after `upload`
+class TextMesh3D {
+    TextBatch3D m_text {};
+    Mesh m_mesh {};
+    Material m_material {};
+
+public:
+    TextMesh3D() = default;
+    TextMesh3D(const TextMesh3D&) = delete;
+    TextMesh3D& operator=(const TextMesh3D&) = delete;
+    /// drops the appended text, the uploaded mesh stays until the next `upload`
+    void clear(Font font);
+    Vector2 append_codepoint(int codepoint, Vector3 pos, float font_size, const Color& color,
+        bool backface = false, const Rotation& rotation = Rotation::none());
+    void append_text(const char* txt, Vector3 pos, float font_size, float spacing,
+        const Color& color, bool backface = false, const Rotation& rotation = Rotation::none());
+    /// vertices appended so far, can be used as a draw range
+    size_t vertex_count(void) const;
+    /// needs the GL context
+    void upload(void);
+    /// draws the first `count` vertices of the uploaded mesh
+    void draw(size_t count = std::numeric_limits<size_t>::max()) const;
+    void unload(void);
+};
+
 class Game;
 
 struct Config {
@@ -129,10 +201,18 @@ struct Config {
     bool wrap_lines = false;
     int font_size = 40;
     bool syntax_highlighting = true;
+    /// wall-clock budget of one evaluation of the player's code, 0 means no limit
+    int eval_budget_ms = 5000;
+    /// lua instruction budget of one evaluation of the player's code, 0 means no limit
+    long long eval_budget_instructions = 0;
+    LuaGcMode eval_gc_mode = LuaGcMode::Generational;
+    /// resolution of the 3D view while the camera moves, relative to the full resolution
+    float moving_render_scale = 0.5f;
 };
 struct Window {
 protected:
     Rectangle m_bounds {};
+    bool m_redraw_requested = true;
 
 public:
     virtual void init(Game& game_state) = 0;
@@ -149,27 +229,23 @@ public:
     }
     inline virtual void on_config_reload(const Config& conf) { };
     inline virtual void on_transition(Game& game_state) { };
-    inline virtual ~Window() { };
-};
-
-struct CubeData {
-    int x {}, y {}, z {};
-    std::vector<std::vector<std::vector<Color>>> color_data {};
-    inline CubeData(int x, int y, int z)
-        : x(x)
-        , y(y)
-        , z(z)
-        , color_data(x, std::vector<std::vector<Color>>(y, std::vector<Color>(z)))
+    /// makes the game draw the next frame even without any input, a window that animates
+    /// something has to keep requesting redraws until the animation is over
+    inline void request_redraw(void)
+    {
+        m_redraw_requested = true;
+    }
+    inline bool is_redraw_requested(void) const
     {
+        return m_redraw_requested;
     }
-    inline CubeData()
-        : x(0)
-        , y(0)
-        , z(0)
-        , color_data(0)
+    inline bool take_redraw_request(void)
     {
+        return std::exchange(m_redraw_requested, false);
     }
+    inline virtual ~Window() { };
 };
+
 namespace raw {
     struct LevelData {
         int X {}, Y {}, Z {};
@@ -194,14 +270,27 @@ struct Level {
 class Game {
 public:
     struct WindowData;
+    struct EvaluationResult {
+        std::optional<std::string> error {};
+        /// the source that was evaluated
+        std::string source {};
+        /// the source solved the level and was saved as its new smallest solution
+        bool solution_saved = false;
+    };
 
 private:
     Vector2 m_dims {};
-    lua_State* m_lua_state {};
+    LuaSandbox m_sandbox {};
     size_t m_current_window {};
     std::string m_current_save_name {};
     Config m_conf = {};
     std::optional<raw::LevelData> m_solution {};
+    std::optional<CubeCensus> m_census {};
+    /// bumped every time `cube` or the solution changes
+    uint64_t m_cube_version {};
+    VoxelEvaluator m_evaluator {};
+    /// whether the next frame has to be drawn, when nothing changed drawing is skipped
+    bool m_redraw = true;
 
 public:
     Font font;
@@ -225,7 +314,16 @@ public:
     void update();
     void draw();
     void update_measurements(void);
-    std::optional<std::string> load_source(const std::string&);
+    /// starts evaluating the source in the background, cancels the evaluation in progress
+    void load_source(std::string source);
+    void cancel_evaluation(void);
+    bool is_evaluating(void) const;
+    /// progress of the current evaluation in range [0, 1]
+    float get_evaluation_progress(void) const;
+    /// result of the last finished evaluation, empty until one finishes for the current level
+    const std::optional<EvaluationResult>& get_evaluation_result(void) const;
+    /// bumped every time an evaluation finishes
+    uint64_t get_evaluation_count(void) const;
     void load_level(const Level& lvl, std::string name);
     void preload_lua_level(Level& lvl);
     Color color_for(int x, int y, int z);
@@ -235,18 +333,84 @@ public:
     void save_game_data(void);
     void reload_configuration(std::string&&);
     const std::optional<raw::LevelData>& get_lvl_data(void);
+    /// comparison of `cube` against the solution, empty when no level is loaded
+    const std::optional<CubeCensus>& get_census(void) const;
+    /// changes whenever `cube`, the solution or the census change
+    uint64_t get_cube_version(void) const;
 
 private:
-    void init_lua_state(void);
+    void reset_lua_state(void);
+    /// blocks on the next input event unless something changes on its own
+    void update_event_waiting(void);
+    /// once the background evaluation finishes this swaps the evaluated cube in and stores
+    /// the result, whichever window is open
+    void poll_evaluation(void);
+    /// escape only cancels the evaluation while the editor is open, otherwise it is the
+    /// exit key like before the evaluation started
+    void update_exit_key(void);
+
+    // background evaluation state, declared last so that the evaluation thread
+    // is joined before anything it touches gets destroyed
+    CubeData m_back_cube {};
+    EvaluationResult m_eval_result {};
+    std::optional<EvaluationResult> m_last_eval_result {};
+    uint64_t m_eval_count {};
+    std::optional<CubeCensus> m_eval_census {};
+    std::atomic<size_t> m_eval_progress {};
+    std::atomic<bool> m_eval_done {};
+    std::jthread m_eval_thread {};
 };
 class EditorWindow final : public Window {
     std::unique_ptr<bed::TextBuffer> m_text_buffer;
     std::unique_ptr<bed::TextBuffer> m_output_buffer;
     Camera3D m_camera = {};
+    /// matches the size of the viewport on screen
     RenderTexture2D m_render_tex = {};
-    Vector2 m_render_tex_dims = { 800, 800 };
+    Vector2 m_render_tex_dims = {};
+    /// the part of the render texture the scene was last drawn into
+    Vector2 m_rendered_dims = {};
+    float m_moving_render_scale = 0.5f;
+    bool m_camera_moving = false;
     Rectangle m_cube_bounds = {};
     Slider m_slider = {};
+    int m_shown_progress = -1;
+    /// the evaluation count of the last result shown in the output buffer
+    uint64_t m_shown_evaluation {};
+    /// how a voxel of the cube shows up in the 3D view
+    enum struct VoxelLook {
+        Hidden,
+        Solid,
+        /// opaque but not the color of the solution, drawn as a small red cube
+        WrongColor,
+        /// not there but part of the solution, drawn as a small cube of the solution color
+        Missing,
+    };
+    struct PickedVoxel {
+        int x {}, y {}, z {};
+        VoxelLook look {};
+        Color color {};
+        /// the color in the solution
+        Color expected {};
+    };
+    VoxelRenderer m_voxel_renderer {};
+    std::vector<VoxelRenderer::Instance> m_voxel_instances {};
+    VoxelMeshData m_voxel_mesh {};
+    /// content hash of every chunk (brick) of the cube as it was last meshed, 0 when empty
+    std::vector<uint64_t> m_chunk_hashes {};
+    uint64_t m_drawn_cube_version = std::numeric_limits<uint64_t>::max();
+    int m_drawn_layer = -1;
+    /// grid numbers and axis marks, rebuilt when the cube dimensions or the font change
+    TextMesh3D m_label_mesh {};
+    std::array<int, 4> m_label_key = { -1, -1, -1, -1 };
+    /// vertex count of the label mesh with the first n y numbers
+    std::vector<size_t> m_label_y_vertices {};
+    /// the render texture is a cache of the 3D scene, it is only redrawn when this is set
+    bool m_scene_dirty = true;
+    size_t m_scene_renders {};
+    /// seconds spent in render_scene since m_scene_renders_since
+    double m_scene_render_time {};
+    double m_scene_renders_since {};
+    double m_scene_renders_per_second {};
 
 public:
     explicit EditorWindow();
@@ -258,9 +422,23 @@ public:
     virtual ~EditorWindow();
     virtual void on_config_reload(const Config& conf) override;
     virtual void on_transition(Game& game_state) override;
+    /// how often the 3D scene was drawn into the render texture during the last second
+    double get_scene_renders_per_second(void) const;
 
 private:
     void update_bounds(void);
+    /// rebuilds the voxel meshes and the marker instances of all layers when the cube
+    /// changed, returns whether anything was rebuilt
+    bool update_voxel_geometry(Game& game_state);
+    static VoxelLook look_of(const CubeData& cube, const CubeData* solution,
+        const std::optional<CubeCensus>& census, int x, int y, int z);
+    /// the first visible voxel under the mouse cursor
+    std::optional<PickedVoxel> pick_voxel(Game& game_state, int layer);
+    /// (re)creates the render texture when the viewport changed size
+    void update_render_texture(void);
+    void update_label_mesh(Game& game_state);
+    /// draws the 3D scene into the render texture
+    void render_scene(Game& game_state, int layer);
 };
 class LevelSelectWindow final : public Window {
     std::unique_ptr<bed::TextBuffer> m_lvl_text_buffer = nullptr;
@@ -8,6 +8,11 @@ extern "C" {
 }
 #endif
 #include <format>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 namespace boot::lua {
 
     namespace {
@@ -26,40 +31,45 @@ namespace boot::lua {
                 static_assert(false, "Unsupported type T");
             }
         }
+        /// reads the value at `idx` without touching the stack
         template <typename T>
-        inline std::optional<T> genericget(lua_State* L)
+        inline std::optional<T> genericto(lua_State* L, int idx)
         {
-            if (lua_isnil(L, -1))
-                return std::nullopt;
             bool check = false;
             if constexpr (std::is_same_v<T, bool>) {
-                check = lua_isboolean(L, -1);
+                check = lua_isboolean(L, idx);
             } else if constexpr (std::is_integral_v<T>) {
-                check = lua_isinteger(L, -1);
+                check = lua_isinteger(L, idx);
             } else if constexpr (std::is_floating_point_v<T>) {
-                check = lua_isnumber(L, -1);
+                check = lua_isnumber(L, idx);
             } else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, std::string>) {
-                check = lua_isstring(L, -1);
+                check = lua_isstring(L, idx);
             } else {
                 static_assert(false, "Unsupported type T");
             }
-            if (!check) {
-                lua_settop(L, 0);
+            if (!check)
                 return std::nullopt;
-            }
             std::optional<T> ret;
             if constexpr (std::is_same_v<T, bool>) {
-                ret = lua_toboolean(L, -1);
+                ret = lua_toboolean(L, idx);
             } else if constexpr (std::is_integral_v<T>) {
-                ret = lua_tointeger(L, -1);
+                ret = lua_tointeger(L, idx);
             } else if constexpr (std::is_floating_point_v<T>) {
-                ret = lua_tonumber(L, -1);
+                ret = lua_tonumber(L, idx);
             } else if constexpr (std::is_same_v<T, const char*>) {
-                ret = lua_tostring(L, -1);
+                ret = lua_tostring(L, idx);
             } else if constexpr (std::is_same_v<T, std::string>) {
-                auto tmp = lua_tostring(L, -1);
+                auto tmp = lua_tostring(L, idx);
                 ret = std::string(tmp);
             }
+            return ret;
+        }
+        template <typename T>
+        inline std::optional<T> genericget(lua_State* L)
+        {
+            if (lua_isnil(L, -1))
+                return std::nullopt;
+            auto ret = genericto<T>(L, -1);
             lua_settop(L, 0);
             return ret;
         }
@@ -111,6 +121,96 @@ namespace boot::lua {
         return genericget<Ret>(L);
     }
 
+    template <typename Signature>
+    class PreparedCall;
+
+    /// A lua function resolved once and kept in a registry reference. Calling it pushes the
+    /// typed arguments straight onto the stack and reads the typed return value back, no
+    /// name lookups and no global table involved. Errors are thrown as std::runtime_error.
+    template <typename Ret, typename... Args>
+    class PreparedCall<Ret(Args...)> {
+    public:
+        using result_t = std::conditional_t<std::is_void_v<Ret>, void, std::optional<Ret>>;
+
+    private:
+        lua_State* m_L {};
+        int m_ref = LUA_NOREF;
+
+    public:
+        PreparedCall() = default;
+        /// pops the function on top of the stack
+        inline explicit PreparedCall(lua_State* L)
+            : m_L(L)
+        {
+            if (!lua_isfunction(L, -1)) {
+                lua_settop(L, 0);
+                throw std::runtime_error("value on top of the stack is not a function");
+            }
+            m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+        /// resolves the global function `function`
+        inline explicit PreparedCall(lua_State* L, const char* function)
+            : m_L(L)
+        {
+            lua_getglobal(L, function);
+            if (!lua_isfunction(L, -1)) {
+                lua_settop(L, 0);
+                throw std::runtime_error(std::format("Lua function '{}' does not exist", function));
+            }
+            m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+        inline PreparedCall(PreparedCall&& other) noexcept
+            : m_L(std::exchange(other.m_L, nullptr))
+            , m_ref(std::exchange(other.m_ref, LUA_NOREF))
+        {
+        }
+        inline PreparedCall& operator=(PreparedCall&& other) noexcept
+        {
+            if (this != &other) {
+                release();
+                m_L = std::exchange(other.m_L, nullptr);
+                m_ref = std::exchange(other.m_ref, LUA_NOREF);
+            }
+            return *this;
+        }
+        PreparedCall(const PreparedCall&) = delete;
+        PreparedCall& operator=(const PreparedCall&) = delete;
+        inline ~PreparedCall()
+        {
+            release();
+        }
+        inline explicit operator bool() const
+        {
+            return m_ref != LUA_NOREF;
+        }
+        /// leaves the stack as it was before the call
+        inline result_t operator()(Args const&... args) const
+        {
+            constexpr const int retcount = std::is_void_v<Ret> ? 0 : 1;
+            lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_ref);
+            (genericpush(m_L, args), ...);
+            if (lua_pcall(m_L, sizeof...(Args), retcount, 0) != LUA_OK) {
+                const auto* msg = lua_tostring(m_L, -1);
+                auto error = std::string(msg ? msg : "unknown error");
+                lua_pop(m_L, 1);
+                throw std::runtime_error(error);
+            }
+            if constexpr (!std::is_void_v<Ret>) {
+                auto ret = genericto<Ret>(m_L, -1);
+                lua_pop(m_L, 1);
+                return ret;
+            }
+        }
+
+    private:
+        inline void release(void)
+        {
+            if (m_L && m_ref != LUA_NOREF)
+                luaL_unref(m_L, LUA_REGISTRYINDEX, m_ref);
+            m_ref = LUA_NOREF;
+        }
+    };
+
     namespace {
         template <typename Optional>
         struct StripOptional {
@@ -0,0 +1,178 @@
+#ifndef BOOT_VOXEL_MESH_HPP
+#define BOOT_VOXEL_MESH_HPP
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <raylib.h>
+#include <vector>
+namespace boot {
+
+/// bit of the faces pointing along `axis` in direction `side` (-1 or 1)
+constexpr inline unsigned face_bit(int axis, int side)
+{
+    return 1u << (axis * 2 + (side > 0));
+}
+constexpr const unsigned ALL_FACES = 0x3f;
+
+/// triangle soup of a voxel mesh, 3 floats per vertex and 4 bytes of color per vertex
+struct VoxelMeshData {
+    /// [start, end) of a range of vertices
+    struct Range {
+        uint32_t start {}, end {};
+    };
+    std::vector<float> vertices {};
+    std::vector<unsigned char> colors {};
+    /// first y layer of a mesh built by `greedy_mesh_layers`
+    int first_layer {};
+    /// vertex count after the faces of every layer, layer_ends[i] ends layer first_layer + i
+    std::vector<uint32_t> layer_ends {};
+    /// top faces of every layer that are covered by the layer above, they only get drawn
+    /// when the layers above are cut off
+    std::vector<Range> caps {};
+    inline size_t vertex_count(void) const
+    {
+        return vertices.size() / 3;
+    }
+    inline void clear(void)
+    {
+        vertices.clear();
+        colors.clear();
+        first_layer = 0;
+        layer_ends.clear();
+        caps.clear();
+    }
+};
+
+/// FNV-1a hash of everything `greedy_mesh` looks at for the region [min, max), which is
+/// the region grown by one voxel on every side, seeded with `seed`. Never returns 0 so
+/// that 0 can stand for a region that was never meshed.
+template <typename SolidFn>
+uint64_t hash_mesh_region(const std::array<int, 3>& min, const std::array<int, 3>& max,
+    uint64_t seed, SolidFn&& solid)
+{
+    constexpr const uint64_t FNV_PRIME = 0x100000001b3;
+    uint64_t hash = 0xcbf29ce484222325 ^ seed;
+    for (int x = min[0] - 1; x <= max[0]; x++) {
+        for (int y = min[1] - 1; y <= max[1]; y++) {
+            for (int z = min[2] - 1; z <= max[2]; z++) {
+                hash = (hash ^ solid(x, y, z)) * FNV_PRIME;
+            }
+        }
+    }
+    return hash ? hash : 1;
+}
+
+/// Greedy meshes the solid voxels in the region [min, max). Faces hidden by a solid
+/// neighbour are culled and neighbouring faces of the same color are merged into one quad.
+/// `solid(x, y, z)` returns the packed color of a voxel (see CubeData::pack) or 0 when the
+/// voxel is not solid, it also gets asked about the neighbours just outside the region.
+/// The voxel (x, y, z) spans [origin + (x, y, z), origin + (x, y, z) + 1]. Only the faces
+/// selected by `faces` (see `face_bit`) are meshed.
+template <typename SolidFn>
+void greedy_mesh(const std::array<int, 3>& min, const std::array<int, 3>& max, Vector3 origin,
+    SolidFn&& solid, VoxelMeshData& out, unsigned faces = ALL_FACES)
+{
+    const float base[3] = { origin.x, origin.y, origin.z };
+    std::vector<uint32_t> mask {};
+    const auto emit_vertex = [&](const float (&p)[3], uint32_t color) {
+        out.vertices.insert(out.vertices.end(), { p[0], p[1], p[2] });
+        unsigned char rgba[4] = {};
+        std::memcpy(rgba, &color, sizeof(rgba));
+        out.colors.insert(out.colors.end(), { rgba[0], rgba[1], rgba[2], rgba[3] });
+    };
+    for (int d = 0; d < 3; d++) {
+        // (d, u, v) is a cyclic permutation of the axes so that u x v points along +d
+        const int u = (d + 1) % 3;
+        const int v = (d + 2) % 3;
+        const int u_len = max[u] - min[u];
+        const int v_len = max[v] - min[v];
+        if (u_len <= 0 || v_len <= 0)
+            continue;
+        mask.resize(static_cast<size_t>(u_len) * v_len);
+        for (int side = -1; side <= 1; side += 2) {
+            if (!(faces & face_bit(d, side)))
+                continue;
+            for (int s = min[d]; s < max[d]; s++) {
+                for (int j = 0; j < v_len; j++) {
+                    for (int i = 0; i < u_len; i++) {
+                        int p[3] {};
+                        p[d] = s;
+                        p[u] = min[u] + i;
+                        p[v] = min[v] + j;
+                        const uint32_t c = solid(p[0], p[1], p[2]);
+                        p[d] += side;
+                        mask[j * u_len + i] = c && !solid(p[0], p[1], p[2]) ? c : 0;
+                    }
+                }
+                for (int j = 0; j < v_len; j++) {
+                    for (int i = 0; i < u_len;) {
+                        const uint32_t c = mask[j * u_len + i];
+                        if (!c) {
+                            i++;
+                            continue;
+                        }
+                        int w = 1;
+                        while (i + w < u_len && mask[j * u_len + i + w] == c)
+                            w++;
+                        int h = 1;
+                        for (; j + h < v_len; h++) {
+                            bool row_matches = true;
+                            for (int k = 0; k < w && row_matches; k++)
+                                row_matches = mask[(j + h) * u_len + i + k] == c;
+                            if (!row_matches)
+                                break;
+                        }
+                        for (int l = 0; l < h; l++)
+                            std::fill_n(mask.begin() + (j + l) * u_len + i, w, 0);
+
+                        float corners[4][3] {};
+                        for (auto& corner : corners) {
+                            corner[d] = base[d] + s + (side > 0 ? 1 : 0);
+                            corner[u] = base[u] + min[u] + i;
+                            corner[v] = base[v] + min[v] + j;
+                        }
+                        corners[1][u] += w;
+                        corners[2][u] += w;
+                        corners[2][v] += h;
+                        corners[3][v] += h;
+                        // counter clockwise when looking at the face from outside
+                        const std::array<int, 6> order = side > 0
+                            ? std::array<int, 6> { 0, 1, 2, 0, 2, 3 }
+                            : std::array<int, 6> { 0, 2, 1, 0, 3, 2 };
+                        for (const int corner : order)
+                            emit_vertex(corners[corner], c);
+                        i += w;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Like `greedy_mesh` but the mesh is laid out by y layer so that any number of the lowest
+/// layers can be drawn as a prefix of it. Faces are only merged within a layer and the tops
+/// that would be exposed by cutting off the layers above go into `out.caps`.
+template <typename SolidFn>
+void greedy_mesh_layers(const std::array<int, 3>& min, const std::array<int, 3>& max,
+    Vector3 origin, SolidFn&& solid, VoxelMeshData& out)
+{
+    out.first_layer = min[1];
+    for (int y = min[1]; y < max[1]; y++) {
+        greedy_mesh({ min[0], y, min[2] }, { max[0], y + 1, max[2] }, origin, solid, out);
+        out.layer_ends.push_back(out.vertex_count());
+    }
+    for (int y = min[1]; y < max[1]; y++) {
+        // the tops that are hidden under a solid voxel, with nothing above them
+        const auto covered = [&](int x, int cy, int z) -> uint32_t {
+            if (cy != y || !solid(x, y + 1, z))
+                return 0;
+            return solid(x, y, z);
+        };
+        const auto start = static_cast<uint32_t>(out.vertex_count());
+        greedy_mesh({ min[0], y, min[2] }, { max[0], y + 1, max[2] }, origin, covered, out,
+            face_bit(1, 1));
+        out.caps.push_back({ start, static_cast<uint32_t>(out.vertex_count()) });
+    }
+}
+}
+#endif
@@ -0,0 +1,73 @@
+#ifndef BOOT_VOXEL_RAYCAST_HPP
+#define BOOT_VOXEL_RAYCAST_HPP
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <raylib.h>
+namespace boot {
+
+/// Walks the ray through a grid of `dims` voxels with the 3D DDA of Amanatides and Woo and
+/// returns the first voxel for which `hit(x, y, z)` is true. The voxel (x, y, z) spans
+/// [origin + (x, y, z), origin + (x, y, z) + 1], so this visits at most x + y + z voxels.
+template <typename HitFn>
+std::optional<std::array<int, 3>> raycast_voxels(const Ray& ray, Vector3 origin,
+    const std::array<int, 3>& dims, HitFn&& hit)
+{
+    constexpr const float INF = std::numeric_limits<float>::infinity();
+    const float pos[3] = { ray.position.x - origin.x, ray.position.y - origin.y,
+        ray.position.z - origin.z };
+    const float dir[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+    // clip the ray against the bounds of the grid first
+    float t_enter = 0, t_exit = INF;
+    for (int a = 0; a < 3; a++) {
+        if (dims[a] <= 0)
+            return std::nullopt;
+        if (dir[a] == 0) {
+            if (pos[a] < 0 || pos[a] > dims[a])
+                return std::nullopt;
+            continue;
+        }
+        float t0 = -pos[a] / dir[a];
+        float t1 = (dims[a] - pos[a]) / dir[a];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        t_enter = std::max(t_enter, t0);
+        t_exit = std::min(t_exit, t1);
+    }
+    if (t_enter > t_exit)
+        return std::nullopt;
+
+    int cell[3] {}, step[3] {};
+    float t_max[3] {}, t_delta[3] {};
+    for (int a = 0; a < 3; a++) {
+        const float start = pos[a] + dir[a] * t_enter;
+        cell[a] = std::clamp(static_cast<int>(std::floor(start)), 0, dims[a] - 1);
+        if (dir[a] > 0) {
+            step[a] = 1;
+            t_delta[a] = 1 / dir[a];
+            t_max[a] = (cell[a] + 1 - pos[a]) / dir[a];
+        } else if (dir[a] < 0) {
+            step[a] = -1;
+            t_delta[a] = -1 / dir[a];
+            t_max[a] = (cell[a] - pos[a]) / dir[a];
+        } else {
+            t_delta[a] = t_max[a] = INF;
+        }
+    }
+    while (true) {
+        if (hit(cell[0], cell[1], cell[2]))
+            return std::array<int, 3> { cell[0], cell[1], cell[2] };
+        const int a = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2)
+                                           : (t_max[1] < t_max[2] ? 1 : 2);
+        if (t_max[a] > t_exit)
+            return std::nullopt;
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= dims[a])
+            return std::nullopt;
+        t_max[a] += t_delta[a];
+    }
+}
+}
+#endif
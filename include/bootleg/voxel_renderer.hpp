@@ -0,0 +1,77 @@
+#ifndef BOOT_VOXEL_RENDERER_HPP
+#define BOOT_VOXEL_RENDERER_HPP
+#include "bootleg/voxel_mesh.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <raylib.h>
+#include <vector>
+namespace boot {
+
+/// Draws the solid voxels as cached greedy meshes, one per chunk of the cube, and every
+/// other voxel (the markers) as instances of a single unit cube in one draw call. Both live
+/// on the GPU and only get uploaded again through `set_chunk_mesh` and `set_instances`.
+/// Meshes and instances are laid out by y layer, so cutting off the upper layers only
+/// shortens the ranges that get drawn.
+class VoxelRenderer {
+public:
+    struct Instance {
+        Vector3 position {};
+        float scale {};
+        Color color {};
+    };
+
+private:
+    struct Chunk {
+        unsigned int vao {};
+        unsigned int position_vbo {};
+        unsigned int color_vbo {};
+        size_t vertex_count {};
+        int first_layer {};
+        std::vector<uint32_t> layer_ends {};
+        std::vector<VoxelMeshData::Range> caps {};
+    };
+    Shader m_shader {};
+    int m_mvp_loc = -1;
+    int m_position_loc = -1;
+    int m_scale_loc = -1;
+    int m_color_loc = -1;
+    unsigned int m_vao {};
+    unsigned int m_cube_vbo {};
+    unsigned int m_instance_vbo {};
+    size_t m_instance_capacity {};
+    size_t m_instance_count {};
+    std::vector<size_t> m_instance_layer_ends {};
+    Shader m_mesh_shader {};
+    int m_mesh_mvp_loc = -1;
+    int m_mesh_position_loc = -1;
+    int m_mesh_color_loc = -1;
+    std::vector<Chunk> m_chunks {};
+    size_t m_mesh_vertex_count {};
+
+    void unload_chunk(Chunk& chunk);
+
+public:
+    VoxelRenderer() = default;
+    VoxelRenderer(const VoxelRenderer&) = delete;
+    VoxelRenderer& operator=(const VoxelRenderer&) = delete;
+    /// needs the GL context, call after InitWindow
+    void init(void);
+    void unload(void);
+    /// the instances have to be sorted by layer, `layer_ends[y]` is the number of instances
+    /// in the layers up to and including y
+    void set_instances(const std::vector<Instance>& instances, std::vector<size_t> layer_ends);
+    size_t get_instance_count(void) const;
+    /// unloads every chunk mesh and makes room for `count` empty chunks
+    void set_chunk_count(size_t count);
+    size_t get_chunk_count(void) const;
+    /// replaces the mesh of one chunk with one built by `greedy_mesh_layers`, an empty mesh
+    /// draws nothing
+    void set_chunk_mesh(size_t chunk, const VoxelMeshData& data);
+    /// vertices of all chunk meshes together
+    size_t get_mesh_vertex_count(void) const;
+    /// draws the layers below `layer` with the current camera, call between BeginMode3D and
+    /// EndMode3D
+    void draw(int layer) const;
+};
+}
+#endif
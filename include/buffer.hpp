@@ -5,11 +5,12 @@
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include "block_list.hpp"
 #include <functional>
 #include <optional>
 #include <raylib.h>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #define IsKeyPressedOrRepeat(KEY) (IsKeyPressed(KEY) || IsKeyPressedRepeat(KEY))
@@ -21,11 +22,29 @@ struct TextBuffer;
 struct TextBuffer {
     using char_t = char;
     using line_t = std::basic_string<char_t>;
+    /// state of the syntax parser at the end of a line, for the things that span lines
+    using syntax_state_t = int;
+    /// colors a line from `col` up to the next span
+    struct SyntaxSpan {
+        long col {};
+        Color color {};
+    };
     struct Line {
         line_t contents {};
         std::optional<Vector2> dims {};
         int lines_when_wrapped = 1;
+        /// syntax colors of the line, sorted by column and no two neighbours have the same color
+        std::vector<SyntaxSpan> syntax {};
+        syntax_state_t syntax_state {};
+    };
+    /// weighs lines by their wrapped rows so m_lines keeps the row sums
+    struct LineRows {
+        long operator()(const Line& line) const
+        {
+            return line.lines_when_wrapped;
+        }
     };
+    using lines_t = BlockList<Line, LineRows>;
     struct Cursor {
         long line {};
         long col {};
@@ -53,16 +72,19 @@ struct TextBuffer {
         {
             return (*this > b) || (*this == b);
         }
-        struct HashFn {
-            std::size_t operator()(const Cursor& cursor) const noexcept
-            {
-                auto h1 = std::hash<long>()(cursor.line);
-                auto h2 = std::hash<long>()(cursor.col);
-                return h1 ^ h2;
-            }
-        };
     };
-    using syntax_data_t = std::unordered_map<Cursor, Color, Cursor::HashFn>;
+    /// what a syntax parser writes the colors of one line into
+    class syntax_data_t {
+        std::vector<SyntaxSpan>* m_spans = nullptr;
+        long m_line {};
+
+    public:
+        syntax_data_t(std::vector<SyntaxSpan>& spans, long line);
+        /// colors the line from `pos` on, positions are expected in order and appending at the
+        /// position of the last span again replaces its color, positions on other lines are
+        /// ignored
+        void append(Cursor pos, Color color);
+    };
     struct Selection {
         Cursor start {};
         Cursor end {};
@@ -75,25 +97,33 @@ struct TextBuffer {
         }
     };
     class text_buffer_iterator;
-    using process_syntax_fn = std::function<void(syntax_data_t&, text_buffer_iterator, const text_buffer_iterator)>;
+    /// parses one line, [begin, end) is the line and its '\n', `state` is the state at the end
+    /// of the line above and the state at the end of this line is returned
+    using process_syntax_fn = std::function<syntax_state_t(syntax_data_t&, syntax_state_t state,
+        text_buffer_iterator begin, const text_buffer_iterator end)>;
 
 private:
     text_buffer_iterator create_begin_iterator(void) const;
     text_buffer_iterator create_end_iterator(void) const;
+    text_buffer_iterator create_line_iterator(std::size_t line) const;
 
 public:
     class text_buffer_iterator {
-        const std::vector<TextBuffer::Line>* m_lines = nullptr;
+        const TextBuffer::lines_t* m_lines = nullptr;
+        // the line m_line, indexing m_lines for every character would be O(log n)
+        const TextBuffer::Line* m_current_line = nullptr;
         size_t m_line {};
         size_t m_col {};
         size_t m_sz {};
         size_t m_current_line_len {};
         bool issue_newline = false;
 
-        text_buffer_iterator(const std::vector<TextBuffer::Line>* lines);
-        static text_buffer_iterator end(const std::vector<TextBuffer::Line>* lines);
+        text_buffer_iterator(const TextBuffer::lines_t* lines);
+        static text_buffer_iterator end(const TextBuffer::lines_t* lines);
+        static text_buffer_iterator at_line(const TextBuffer::lines_t* lines, std::size_t line);
         friend text_buffer_iterator TextBuffer::create_begin_iterator(void) const;
         friend text_buffer_iterator TextBuffer::create_end_iterator(void) const;
+        friend text_buffer_iterator TextBuffer::create_line_iterator(std::size_t line) const;
 
     public:
         TextBuffer::char_t operator*() const;
@@ -105,7 +135,7 @@ public:
     };
 
 private:
-    std::vector<Line> m_lines = { {} };
+    lines_t m_lines = { Line {} };
     std::optional<Selection> m_selection {};
     Cursor m_cursor = {};
     Font m_font {};
@@ -130,7 +160,9 @@ private:
     bool m_do_common_updates = false;
 
     process_syntax_fn m_syntax_parse_fn = nullptr;
-    syntax_data_t m_syntax_data {};
+    // lines [begin, end) that changed since the last update_syntax
+    std::size_t m_syntax_dirty_begin {};
+    std::size_t m_syntax_dirty_end {};
 
 public:
     Color foreground_color = WHITE;
@@ -243,6 +275,8 @@ public:
     float measure_line_till_cursor(void);
     void measure_lines(void);
     void measure_line(Line& line);
+    /// measures the line `line` of the buffer and updates its rows
+    void measure_line(std::size_t line);
     // draws
     void draw(void);
     void draw_vertical_scroll_bar(void);
@@ -252,8 +286,13 @@ public:
     void update_buffer(void);
     /// this function ensures that the viewport contains the cursor (the cursor is visible on the screen)
     void update_viewport_to_cursor(void);
+    /// the updates the edits left for later (total height, viewport, scroll, syntax), called
+    /// by update_buffer every frame
+    void update_after_edits(void);
 
     void set_syntax_parser(process_syntax_fn fn);
+    /// re-parses the lines that changed and the lines below them until the parser state at the
+    /// end of a line is the same as before
     void update_syntax(void);
 
 private:
@@ -265,6 +304,18 @@ private:
     void update_selection(void);
     void update_scroll_v(float v);
     float get_glyph_width(const Font& font, int codepoint) const;
+    void mark_syntax_dirty(std::size_t first, std::size_t last);
+    /// bookkeeping after `count` lines were inserted before the line `at`
+    void lines_inserted(std::size_t at, std::size_t count);
+    /// bookkeeping after the lines [first, last) were erased
+    void lines_erased(std::size_t first, std::size_t last);
+    /// y offset of the top of `line` from the top of the buffer contents
+    float line_y(std::size_t line) const;
+    /// the line at the y offset `y` from the top of the buffer contents and the y offset of
+    /// its top, the last line when `y` is past the end
+    std::pair<std::size_t, float> line_at_y(float y) const;
+    /// color of the syntax data that is in effect just before `pos`
+    Color syntax_color_before(Cursor pos) const;
 
 public:
     text_buffer_iterator begin(void) const;
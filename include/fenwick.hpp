@@ -0,0 +1,65 @@
+#ifndef FENWICK_HPP
+#define FENWICK_HPP
+
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+namespace bed {
+/// Fenwick (binary indexed) tree over a sequence of non-negative values, prefix sums and
+/// point updates are O(log n), building it is O(n)
+template <typename T>
+class FenwickTree {
+    // 1-based, m_tree[i] holds the sum of the (i & -i) values ending at value i - 1
+    std::vector<T> m_tree = { T {} };
+
+public:
+    /// replaces the values with value(0), ..., value(n - 1)
+    template <typename ValueFn>
+    void build(std::size_t n, ValueFn&& value)
+    {
+        m_tree.assign(n + 1, T {});
+        for (std::size_t i = 1; i <= n; i++) {
+            m_tree[i] += value(i - 1);
+            const std::size_t parent = i + (i & -i);
+            if (parent <= n)
+                m_tree[parent] += m_tree[i];
+        }
+    }
+    std::size_t size(void) const
+    {
+        return m_tree.size() - 1;
+    }
+    void add(std::size_t i, T delta)
+    {
+        for (i++; i < m_tree.size(); i += i & -i)
+            m_tree[i] += delta;
+    }
+    /// sum of the first `n` values
+    T prefix_sum(std::size_t n) const
+    {
+        T ret {};
+        for (; n > 0; n -= n & -n)
+            ret += m_tree[n];
+        return ret;
+    }
+    T total(void) const
+    {
+        return prefix_sum(size());
+    }
+    /// the largest n for which prefix_sum(n) <= value
+    std::size_t upper_bound(T value) const
+    {
+        std::size_t pos = 0;
+        for (std::size_t step = std::bit_floor(size()); step > 0; step >>= 1) {
+            if (pos + step < m_tree.size() && m_tree[pos + step] <= value) {
+                pos += step;
+                value -= m_tree[pos];
+            }
+        }
+        return pos;
+    }
+};
+}
+
+#endif
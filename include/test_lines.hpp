@@ -0,0 +1,22 @@
+#ifndef TEST_LINES_HPP
+#define TEST_LINES_HPP
+
+#include <format>
+#include <string>
+
+namespace bed {
+/// `count` numbered lines of text joined by '\n', for filling a TextBuffer when testing how
+/// it behaves with long buffers
+inline std::string make_test_lines(long count)
+{
+    std::string ret = {};
+    for (long i = 0; i < count; i++) {
+        ret.append(std::format("{}: The quick brown fox jumps over the lazy dog", i + 1));
+        if (i + 1 < count)
+            ret.push_back('\n');
+    }
+    return ret;
+}
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "buffer.hpp"
 #include "defer.hpp"
+#include "test_lines.hpp"
 #include "utf8.hpp"
 #include <cassert>
 #include <cstdio>
@@ -7,6 +8,8 @@
 #include <format>
 #include <iostream>
 #include <raylib.h>
+#include <string>
+#include <string_view>
 
 // lifted from raylib examples
 static void add_codepoints_range(Font* font, const char* fontPath, int start, int stop)
@@ -36,6 +39,7 @@ Font try_load_font(char* path)
     add_codepoints_range(&font, path, 0x180, 0x24f);
     return font;
 }
+// usage: bed [font path] [--lines count]
 int main(int argc, char** args)
 {
     Rectangle bounds = {
@@ -44,15 +48,26 @@ int main(int argc, char** args)
         .width = 800,
         .height = 600,
     };
+    char* font_path = nullptr;
+    long test_lines = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(args[i]) == "--lines" && i + 1 < argc)
+            test_lines = std::strtol(args[++i], nullptr, 10);
+        else
+            font_path = args[i];
+    }
     InitWindow(800, 600, "bed");
     SetWindowState(FLAG_WINDOW_RESIZABLE);
     DEFER(CloseWindow());
-    auto font = argc == 2 ? (try_load_font(args[1])) : GetFontDefault();
+    auto font = font_path ? (try_load_font(font_path)) : GetFontDefault();
     DEFER(
         if (font.texture.id != GetFontDefault().texture.id)
             UnloadFont(font););
     bed::TextBuffer _text_buffer = { font, bounds };
-    _text_buffer.insert_string("Welcome to Bed!");
+    if (test_lines > 0)
+        _text_buffer.insert_string(bed::make_test_lines(test_lines));
+    else
+        _text_buffer.insert_string("Welcome to Bed!");
     _text_buffer.set_font_size(50);
     SetTargetFPS(60);
     while (!WindowShouldClose()) {
@@ -71,6 +86,8 @@ int main(int argc, char** args)
         BeginDrawing();
         ClearBackground(BLACK);
         _text_buffer.draw();
+        if (test_lines > 0)
+            DrawFPS(GetScreenWidth() - 100, 10);
         EndDrawing();
     }
 }
@@ -0,0 +1,53 @@
+#include <bootleg/cube_data.hpp>
+#include <bootleg/evaluator.hpp>
+#include <chrono>
+#include <cstdio>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Checks that scripts catching the budget error with pcall/xpcall still get aborted by the
+// instruction budget, the time budget and a cancel, and how long the abort takes. A script
+// escaping the budget makes this hang.
+
+using namespace boot;
+
+static constexpr std::string_view SCRIPTS[] = {
+    "while true do pcall(function() while true do end end) end",
+    "while true do xpcall(function() while true do end end, function() while true do end end) end",
+};
+
+static void run(const char* name, std::string_view script, VoxelEvaluator::Job job, int cancel_after_ms = 0)
+{
+    VoxelEvaluator evaluator {};
+    CubeData cube(16, 16, 16);
+    const auto source = wrap_player_source(script);
+    job.source = source;
+    job.chunk_name = "bench";
+    std::stop_source stop {};
+    job.stop = stop.get_token();
+    std::jthread canceller {};
+    if (cancel_after_ms > 0) {
+        canceller = std::jthread([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(cancel_after_ms));
+            stop.request_stop();
+        });
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const auto err = evaluator.evaluate(job, cube);
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("  %-12s aborted after %.1f ms: %s\n", name, elapsed.count(),
+        err ? err->data() : (cancel_after_ms > 0 ? "cancelled" : "no error"));
+}
+
+int main(void)
+{
+    for (const auto script : SCRIPTS) {
+        std::printf("%.*s\n", static_cast<int>(script.size()), script.data());
+        run("instructions", script, { .instruction_budget = 10'000'000 });
+        run("time", script, { .time_budget = std::chrono::milliseconds(100) });
+        run("cancel", script, {}, 100);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <bootleg/lua_generics.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <string_view>
+
+// Microbenchmark of the per-call overhead of evaluating one voxel, compares passing the
+// voxel through globals (the way the evaluator used to) against lua::PreparedCall
+
+using namespace boot;
+
+static constexpr std::string_view BODY = "if (x + y + z) % 2 == 0 then Color = 0xff0000ff end";
+
+template <typename F>
+static double measure_ns_per_call(int calls, F&& f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+        f(i % 16, (i / 16) % 16, (i / 256) % 16);
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / calls;
+}
+
+static double bench_globals(int calls)
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    auto src = std::format("function Voxel() {} end", BODY);
+    luaL_dostring(L, src.data());
+    long long sum = 0;
+    const auto ns = measure_ns_per_call(calls, [&](int x, int y, int z) {
+        lua::setglobalv(L, "X", 16);
+        lua::setglobalv(L, "Y", 16);
+        lua::setglobalv(L, "Z", 16);
+        lua::setglobalv(L, "Color", 0);
+        lua::setglobalv(L, "x", x);
+        lua::setglobalv(L, "y", y);
+        lua::setglobalv(L, "z", z);
+        lua::voidpcall(L, "Voxel");
+        sum += lua::getglobalv<unsigned int>(L, "Color").value_or(0);
+    });
+    lua_close(L);
+    std::printf("  checksum %lld\n", sum);
+    return ns;
+}
+
+static double bench_prepared(int calls)
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    auto src = std::format("local x, y, z, X, Y, Z, Color "
+                           "local function body() {} end "
+                           "return function(_x, _y, _z, _X, _Y, _Z) "
+                           "x, y, z, X, Y, Z, Color = _x, _y, _z, _X, _Y, _Z, 0 "
+                           "body() "
+                           "return Color "
+                           "end",
+        BODY);
+    luaL_loadbuffer(L, src.data(), src.size(), "bench");
+    lua_call(L, 0, 1);
+    long long sum = 0;
+    double ns = 0;
+    {
+        auto voxel = lua::PreparedCall<int64_t(int, int, int, int, int, int)>(L);
+        ns = measure_ns_per_call(calls, [&](int x, int y, int z) {
+            sum += voxel(x, y, z, 16, 16, 16).value_or(0);
+        });
+    }
+    lua_close(L);
+    std::printf("  checksum %lld\n", sum);
+    return ns;
+}
+
+int main(int argc, char** args)
+{
+    const int calls = argc > 1 ? std::atoi(args[1]) : 1'000'000;
+    std::printf("globals:\n");
+    const auto globals = bench_globals(calls);
+    std::printf("  %.1f ns/call\n", globals);
+    std::printf("prepared call:\n");
+    const auto prepared = bench_prepared(calls);
+    std::printf("  %.1f ns/call\n", prepared);
+    std::printf("speedup: %.2fx\n", globals / prepared);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "buffer.hpp"
+#include "test_lines.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <raylib.h>
+#include <string>
+
+// Microbenchmark of the latency of line edits in a big bed::TextBuffer, an Enter and a
+// Backspace at the start of a line near the start, the middle and the end of the buffer,
+// with and without line wrapping. Every edit is followed by the updates update_buffer runs
+// after it (total height, viewport...) since in wrap mode those go through the row sums
+
+static void move_cursor_to_line(bed::TextBuffer& buffer, long line)
+{
+    buffer.jump_cursor_to_top();
+    buffer.move_cursor_down(line);
+    buffer.jump_cursor_to_start();
+}
+
+// only the edits are timed, not moving the cursor to the line
+template <typename F>
+static double measure_us_per_edit(bed::TextBuffer& buffer, long line, int edits, F&& edit)
+{
+    std::chrono::duration<double, std::micro> elapsed {};
+    for (int i = 0; i < edits; i++) {
+        move_cursor_to_line(buffer, line);
+        const auto start = std::chrono::steady_clock::now();
+        edit();
+        buffer.update_after_edits();
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+    return elapsed.count() / edits;
+}
+
+int main(int argc, char** args)
+{
+    const long lines = argc > 1 ? std::atol(args[1]) : 100'000;
+    const int edits = argc > 2 ? std::atoi(args[2]) : 1'000;
+    // the buffer needs the default font which needs a window
+    SetTraceLogLevel(LOG_WARNING);
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(100, 100, "bench_text_buffer");
+
+    for (const bool wrap : { false, true }) {
+        // narrow enough that every line wraps into several rows
+        bed::TextBuffer buffer = { GetFontDefault(), { 0, 0, 300, 600 } };
+        if (wrap)
+            buffer.toggle_wrap_lines();
+        const auto load_start = std::chrono::steady_clock::now();
+        buffer.insert_string(bed::make_test_lines(lines));
+        const std::chrono::duration<double, std::milli> load = std::chrono::steady_clock::now() - load_start;
+        std::printf("%s: inserting %ld lines: %.1f ms\n", wrap ? "wrapped" : "not wrapped", lines, load.count());
+
+        const struct {
+            const char* name;
+            long line;
+        } positions[] = {
+            { "start", 1 },
+            { "middle", lines / 2 },
+            { "end", lines - 1 },
+        };
+        for (const auto& pos : positions) {
+            const auto enter = measure_us_per_edit(buffer, pos.line, edits, [&] { buffer.insert_newline(); });
+            // every enter left an empty line behind, the backspaces remove them again
+            const auto backspace = measure_us_per_edit(buffer, pos.line + 1, edits, [&] { buffer.concat_backward(); });
+            std::printf("  %s (line %ld):\n", pos.name, pos.line);
+            std::printf("    enter     %.2f us/edit\n", enter);
+            std::printf("    backspace %.2f us/edit\n", backspace);
+            std::printf("    line count %zu\n", buffer.get_line_count());
+        }
+    }
+    CloseWindow();
+    return 0;
+}
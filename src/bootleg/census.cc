@@ -0,0 +1,109 @@
+#include <array>
+#include <bit>
+#include <bootleg/census.hpp>
+#include <bootleg/game.hpp>
+#include <cassert>
+#include <memory>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define BOOT_CENSUS_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BOOT_CENSUS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+constexpr const size_t WORD_BITS = 64;
+using mask_fn_t = uint64_t (*)(const uint32_t* a, const uint32_t* b);
+
+// the kernels return a mask with a bit set for every one of the 64 voxels that differ
+#ifndef BOOT_CENSUS_SSE2
+uint64_t mismatch_mask_scalar(const uint32_t* a, const uint32_t* b)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < WORD_BITS; i++) {
+        mask |= static_cast<uint64_t>(a[i] != b[i]) << i;
+    }
+    return mask;
+}
+#else
+uint64_t mismatch_mask_sse2(const uint32_t* a, const uint32_t* b)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < WORD_BITS; i += 4) {
+        const auto va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        const auto eq = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(va, vb)));
+        mask |= static_cast<uint64_t>(~eq & 0xf) << i;
+    }
+    return mask;
+}
+#endif
+#ifdef BOOT_CENSUS_AVX2
+__attribute__((target("avx2"))) uint64_t mismatch_mask_avx2(const uint32_t* a, const uint32_t* b)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < WORD_BITS; i += 8) {
+        const auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        const auto eq = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(va, vb)));
+        mask |= static_cast<uint64_t>(~eq & 0xff) << i;
+    }
+    return mask;
+}
+#endif
+mask_fn_t pick_mask_fn(void)
+{
+#ifdef BOOT_CENSUS_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return mismatch_mask_avx2;
+#endif
+#ifdef BOOT_CENSUS_SSE2
+    return mismatch_mask_sse2;
+#else
+    return mismatch_mask_scalar;
+#endif
+}
+const std::array<uint32_t, boot::CubeData::BRICK_VOLUME> EMPTY_BRICK {};
+}
+
+namespace boot {
+CubeCensus take_census(const CubeData& cube, const CubeData& solution)
+{
+    assert(cube.same_dims(solution));
+    static const mask_fn_t mask_fn = pick_mask_fn();
+    constexpr const int edge = CubeData::BRICK_EDGE;
+    CubeCensus census {};
+    census.brick_mismatches.resize(cube.brick_count());
+    census.layer_mismatches.resize(cube.y);
+    for (size_t b = 0; b < cube.brick_count(); b++) {
+        if (!cube.has_brick(b) && !solution.has_brick(b))
+            continue;
+        const auto* lhs = cube.has_brick(b) ? cube.brick(b).data() : EMPTY_BRICK.data();
+        const auto* rhs = solution.has_brick(b) ? solution.brick(b).data() : EMPTY_BRICK.data();
+        CubeCensus::brick_mask_t mask {};
+        size_t brick_mismatches = 0;
+        for (size_t w = 0; w < mask.size(); w++) {
+            mask[w] = mask_fn(lhs + w * WORD_BITS, rhs + w * WORD_BITS);
+            brick_mismatches += std::popcount(mask[w]);
+        }
+        if (!brick_mismatches)
+            continue;
+        census.mismatches += brick_mismatches;
+        // a word covers 4 rows of 16 voxels along z, the rows go through y first
+        const int origin_y = cube.brick_origin(b).y;
+        for (size_t w = 0; w < mask.size(); w++) {
+            for (int row = 0; row < 4; row++) {
+                const int y = origin_y + (w * 4 + row) % edge;
+                if (y < cube.y)
+                    census.layer_mismatches[y] += std::popcount((mask[w] >> (row * edge)) & 0xffff);
+            }
+        }
+        census.brick_mismatches[b] = std::make_unique<CubeCensus::brick_mask_t>(mask);
+    }
+    census.completed = census.mismatches == 0;
+    return census;
+}
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <bootleg/cube_data.hpp>
+#include <cstring>
+#include <utility>
+
+namespace {
+constexpr const boot::CubeData::brick_t EMPTY_BRICK {};
+
+bool is_empty(const boot::CubeData::brick_t& brick)
+{
+    return std::memcmp(brick.data(), EMPTY_BRICK.data(), sizeof(EMPTY_BRICK)) == 0;
+}
+int bricks_for(int dim)
+{
+    return (std::max(dim, 0) + boot::CubeData::BRICK_EDGE - 1) / boot::CubeData::BRICK_EDGE;
+}
+}
+
+namespace boot {
+CubeData::CubeData(int x, int y, int z)
+    : x(x)
+    , y(y)
+    , z(z)
+    , m_bx(bricks_for(x))
+    , m_by(bricks_for(y))
+    , m_bz(bricks_for(z))
+    , m_brick_count(static_cast<size_t>(m_bx) * m_by * m_bz)
+    , m_bricks(std::make_unique<std::atomic<brick_t*>[]>(m_brick_count))
+{
+}
+CubeData::CubeData()
+    : CubeData(0, 0, 0)
+{
+}
+CubeData::CubeData(const CubeData& other)
+    : CubeData(other.x, other.y, other.z)
+{
+    copy_from(other);
+}
+CubeData::CubeData(CubeData&& other) noexcept
+    : x(std::exchange(other.x, 0))
+    , y(std::exchange(other.y, 0))
+    , z(std::exchange(other.z, 0))
+    , m_bx(std::exchange(other.m_bx, 0))
+    , m_by(std::exchange(other.m_by, 0))
+    , m_bz(std::exchange(other.m_bz, 0))
+    , m_brick_count(std::exchange(other.m_brick_count, 0))
+    , m_bricks(std::move(other.m_bricks))
+{
+}
+CubeData& CubeData::operator=(const CubeData& other)
+{
+    if (this != &other) {
+        if (!same_dims(other))
+            *this = CubeData(other.x, other.y, other.z);
+        copy_from(other);
+    }
+    return *this;
+}
+CubeData& CubeData::operator=(CubeData&& other) noexcept
+{
+    if (this != &other) {
+        free_bricks();
+        x = std::exchange(other.x, 0);
+        y = std::exchange(other.y, 0);
+        z = std::exchange(other.z, 0);
+        m_bx = std::exchange(other.m_bx, 0);
+        m_by = std::exchange(other.m_by, 0);
+        m_bz = std::exchange(other.m_bz, 0);
+        m_brick_count = std::exchange(other.m_brick_count, 0);
+        m_bricks = std::move(other.m_bricks);
+    }
+    return *this;
+}
+CubeData::~CubeData()
+{
+    free_bricks();
+}
+void CubeData::free_bricks(void)
+{
+    for (size_t b = 0; b < m_brick_count; b++) {
+        delete m_bricks[b].exchange(nullptr, std::memory_order_relaxed);
+    }
+}
+CubeData::brick_t* CubeData::allocate_brick(size_t b)
+{
+    auto* fresh = new brick_t {};
+    brick_t* expected = nullptr;
+    if (m_bricks[b].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+        return fresh;
+    // another thread allocated the brick first
+    delete fresh;
+    return expected;
+}
+CubeData::BrickOrigin CubeData::brick_origin(size_t b) const
+{
+    const int bz = b % m_bz;
+    const int by = (b / m_bz) % m_by;
+    const int bx = b / (static_cast<size_t>(m_bz) * m_by);
+    return BrickOrigin { .x = bx * BRICK_EDGE, .y = by * BRICK_EDGE, .z = bz * BRICK_EDGE };
+}
+size_t CubeData::occupied_bricks(void) const
+{
+    size_t count = 0;
+    for (size_t b = 0; b < m_brick_count; b++) {
+        count += has_brick(b);
+    }
+    return count;
+}
+void CubeData::copy_from(const CubeData& other)
+{
+    if (!same_dims(other)) {
+        *this = other;
+        return;
+    }
+    for (size_t b = 0; b < m_brick_count; b++) {
+        const auto* src = other.m_bricks[b].load(std::memory_order_relaxed);
+        auto* dst = m_bricks[b].load(std::memory_order_relaxed);
+        if (!src) {
+            delete m_bricks[b].exchange(nullptr, std::memory_order_relaxed);
+        } else if (dst) {
+            std::memcpy(dst->data(), src->data(), sizeof(brick_t));
+        } else {
+            m_bricks[b].store(new brick_t(*src), std::memory_order_relaxed);
+        }
+    }
+}
+void CubeData::compact(void)
+{
+    for (size_t b = 0; b < m_brick_count; b++) {
+        auto* brick = m_bricks[b].load(std::memory_order_relaxed);
+        if (brick && is_empty(*brick)) {
+            m_bricks[b].store(nullptr, std::memory_order_relaxed);
+            delete brick;
+        }
+    }
+}
+bool CubeData::operator==(const CubeData& other) const
+{
+    if (!same_dims(other))
+        return false;
+    for (size_t b = 0; b < m_brick_count; b++) {
+        const auto* lhs = m_bricks[b].load(std::memory_order_relaxed);
+        const auto* rhs = other.m_bricks[b].load(std::memory_order_relaxed);
+        if (!lhs && !rhs)
+            continue;
+        if (std::memcmp(lhs ? lhs->data() : EMPTY_BRICK.data(),
+                rhs ? rhs->data() : EMPTY_BRICK.data(), sizeof(brick_t))
+            != 0)
+            return false;
+    }
+    return true;
+}
+}
@@ -1,16 +1,20 @@
+#include <algorithm>
+#include <cmath>
 #include <bootleg/game.hpp>
+#include <bootleg/voxel_raycast.hpp>
 #include <memory>
 #include <optional>
 #include <raylib.h>
 #include <raymath.h>
+#include <rlgl.h>
 #include <string>
 #include <string_view>
 
 constexpr const float BUFFER_MARGIN = .05;
 
 using buffer_t = bed::TextBuffer;
-static void process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
-    buffer_t::text_buffer_iterator tit,
+static buffer_t::syntax_state_t process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
+    buffer_t::syntax_state_t state, buffer_t::text_buffer_iterator tit,
     const buffer_t::text_buffer_iterator end);
 
 boot::EditorWindow::EditorWindow() { }
@@ -43,6 +47,24 @@ void boot::EditorWindow::update_bounds(void)
         buffer_bounds.height = (m_bounds.height - buffer_bounds.y); // - (m_bounds.height / 2 * BUFFER_MARGIN );
         m_output_buffer->set_bounds(buffer_bounds);
     }
+    update_render_texture();
+    m_scene_dirty = true;
+}
+void boot::EditorWindow::update_render_texture(void)
+{
+    // one texel per pixel of the viewport on screen
+    const auto dpi = GetWindowScaleDPI();
+    const Vector2 dims = {
+        std::max(1.f, std::round(m_cube_bounds.width * dpi.x)),
+        std::max(1.f, std::round(m_cube_bounds.height * dpi.y)),
+    };
+    if (m_render_tex.id && dims == m_render_tex_dims)
+        return;
+    if (m_render_tex.id)
+        UnloadRenderTexture(m_render_tex);
+    m_render_tex_dims = dims;
+    m_render_tex = LoadRenderTexture(m_render_tex_dims.x, m_render_tex_dims.y);
+    SetTextureFilter(m_render_tex.texture, TEXTURE_FILTER_BILINEAR);
 }
 void boot::EditorWindow::init(Game& game_state)
 {
@@ -61,15 +83,19 @@ void boot::EditorWindow::init(Game& game_state)
     m_camera.up = (Vector3) { 0.0f, 1.0f, 0.0 };
     m_camera.fovy = 90.0f;
     m_camera.projection = CAMERA_PERSPECTIVE;
-    m_render_tex = LoadRenderTexture(m_render_tex_dims.x, m_render_tex_dims.y);
-    SetTextureFilter(m_render_tex.texture, TEXTURE_FILTER_ANISOTROPIC_4X);
+    m_voxel_renderer.init();
     m_slider = { {}, 0, 1000, 1000 };
     m_slider.bar_color = Color { 0x1f, 0x1f, 0x1f, 80 };
     m_slider.slider_color = YELLOW;
     m_slider.set_value(m_slider.get_max());
     update_bounds();
 }
-boot::EditorWindow::~EditorWindow() { UnloadRenderTexture(m_render_tex); }
+boot::EditorWindow::~EditorWindow()
+{
+    m_voxel_renderer.unload();
+    m_label_mesh.unload();
+    UnloadRenderTexture(m_render_tex);
+}
 void boot::EditorWindow::update(Game& game_state)
 {
     static bool cube_clicked = false;
@@ -81,27 +107,60 @@ void boot::EditorWindow::update(Game& game_state)
     const auto mouse = GetMousePosition();
     cube_clicked = (CheckCollisionPointRec(mouse, m_cube_bounds) && IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) || (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) && cube_clicked);
     if (cube_clicked) {
+        // the camera keeps moving while its keys are held down
+        request_redraw();
+        const auto before = m_camera;
         UpdateCamera(&m_camera, CAMERA_THIRD_PERSON);
+        if (before.position != m_camera.position || before.target != m_camera.target
+            || before.up != m_camera.up) {
+            m_scene_dirty = true;
+            m_camera_moving = true;
+        }
+    } else if (m_camera_moving) {
+        // back to the full resolution once the camera stops
+        m_camera_moving = false;
+        m_scene_dirty = true;
     }
     if (IsKeyPressed(KEY_ENTER) && AnySpecialDown(SHIFT)) {
         m_output_buffer->clear();
-        if (auto err = game_state.load_source(m_text_buffer->get_contents_as_string());
-            err) {
-            auto errstr = *err;
-            m_output_buffer->insert_string(std::move(errstr));
+        m_shown_progress = -1;
+        game_state.load_source(m_text_buffer->get_contents_as_string());
+    } else if (IsKeyPressed(KEY_ESCAPE) && game_state.is_evaluating()) {
+        game_state.cancel_evaluation();
+        m_output_buffer->clear();
+        m_output_buffer->insert_string("Evaluation cancelled");
+    } else {
+        this->m_text_buffer->update_buffer();
+    }
+    // the game collects the results, this only shows the ones it has not shown yet
+    const auto& result = game_state.get_evaluation_result();
+    if (m_shown_evaluation != game_state.get_evaluation_count() && result) {
+        m_shown_evaluation = game_state.get_evaluation_count();
+        request_redraw();
+        m_output_buffer->clear();
+        if (result->error) {
+            m_output_buffer->insert_string(std::string(*result->error));
+        }
+        if (const auto& census = game_state.get_census(); census && census->mismatches) {
+            auto msg = std::format("{}{} voxels wrong", result->error ? "\n" : "", census->mismatches);
+            m_output_buffer->insert_string(std::move(msg));
         }
         if (game_state.level_completed) {
             m_output_buffer->insert_string("Level solved!");
-            auto sol = m_text_buffer->get_contents_as_string();
-            const size_t len = sol.length();
-            auto ret = game_state.save_solution_for_current_level(std::move(sol));
-            if (ret) {
-                auto msg = std::format("[NEW SMALLEST ({} bytes) SOLUTION SAVED]", len);
+            if (result->solution_saved) {
+                auto msg = std::format("[NEW SMALLEST ({} bytes) SOLUTION SAVED]", result->source.length());
                 m_output_buffer->insert_string(std::move(msg));
             }
         }
-    } else {
-        this->m_text_buffer->update_buffer();
+    } else if (game_state.is_evaluating()) {
+        const int progress = game_state.get_evaluation_progress() * 100;
+        if (progress != m_shown_progress) {
+            request_redraw();
+            m_shown_progress = progress;
+            m_output_buffer->clear();
+            m_output_buffer->insert_string(
+                std::format("Evaluating... {}% (<Esc> to cancel)", progress));
+        }
     }
     if (IsKeyPressed(KEY_S) && AnySpecialDown(CONTROL)) {
         game_state.save_source_for_current_level(
@@ -111,41 +170,62 @@ void boot::EditorWindow::update(Game& game_state)
     this->m_output_buffer->update_buffer();
 }
 
+boot::EditorWindow::VoxelLook boot::EditorWindow::look_of(const CubeData& cube,
+    const CubeData* solution, const std::optional<CubeCensus>& census, int x, int y, int z)
+{
+    const Color c = cube.get(x, y, z);
+    const bool mismatch = solution && census && census->is_mismatch(cube, x, y, z);
+    if (c.a == 255) {
+        if (!mismatch)
+            return VoxelLook::Solid;
+        const auto s = solution->get(x, y, z);
+        return (c.r != s.r || c.g != s.g || c.b != s.b) && s.a != 0
+            ? VoxelLook::WrongColor
+            : VoxelLook::Solid;
+    }
+    if (mismatch && solution->get(x, y, z).a)
+        return VoxelLook::Missing;
+    return VoxelLook::Hidden;
+}
+std::optional<boot::EditorWindow::PickedVoxel> boot::EditorWindow::pick_voxel(Game& game_state, int layer)
+{
+    const auto mouse = GetMousePosition();
+    if (!CheckCollisionPointRec(mouse, m_cube_bounds))
+        return std::nullopt;
+    const auto& cube = game_state.cube;
+    const auto& lvl_data = game_state.get_lvl_data();
+    const CubeData* solution = lvl_data ? &lvl_data->solution.value() : nullptr;
+    const auto& census = game_state.get_census();
+    const Vector2 mouse_in_view_prc = { (mouse.x - m_cube_bounds.x) / m_cube_bounds.width,
+        (mouse.y - m_cube_bounds.y) / m_cube_bounds.height };
+    const Vector2 mouse_in_view_real = {
+        m_render_tex_dims.x * mouse_in_view_prc.x,
+        m_render_tex_dims.y * mouse_in_view_prc.y
+    };
+    const auto ray = GetScreenToWorldRayEx(
+        mouse_in_view_real, m_camera, m_render_tex_dims.x, m_render_tex_dims.y);
+    // the same grid the voxel mesh is built on, cut off at the visible layer
+    const Vector3 origin = { -cube.x / 2.f, 0, -cube.z / 2.f };
+    const auto hit = boot::raycast_voxels(ray, origin, { cube.x, std::min(cube.y, layer), cube.z },
+        [&](int x, int y, int z) {
+            return look_of(cube, solution, census, x, y, z) != VoxelLook::Hidden;
+        });
+    if (!hit)
+        return std::nullopt;
+    const auto [x, y, z] = *hit;
+    return PickedVoxel {
+        .x = x,
+        .y = y,
+        .z = z,
+        .look = look_of(cube, solution, census, x, y, z),
+        .color = cube.get(x, y, z),
+        .expected = solution ? solution->get(x, y, z) : BLANK,
+    };
+}
 void boot::EditorWindow::draw(Game& game_state)
 {
     const auto& cube = game_state.cube;
-    const auto brick_width = 1.0f;
-    const auto solution_brick_width = brick_width / 3;
     constexpr auto tooltip_wait_time = 0.5;
-    using tooltip_info_t = std::optional<std::tuple<int, int, int>>;
-    tooltip_info_t tooltip_info = {};
-    const auto draw_solution_tooltip = [&, this](const int& x, const int& y,
-                                           const int& z,
-                                           const Vector3& pos) {
-        const auto mouse = GetMousePosition();
-        if (!CheckCollisionPointRec(mouse, m_cube_bounds))
-            return;
-        const BoundingBox bbox = {
-            .min = Vector3Subtract(
-                pos, Vector3Scale({ solution_brick_width, solution_brick_width, solution_brick_width }, 0.5)),
-            .max = Vector3Add(
-                pos, Vector3Scale({ solution_brick_width, solution_brick_width, solution_brick_width }, 0.5)),
-        };
-        const auto mouse_in_view = Vector2 { mouse.x - m_cube_bounds.x, mouse.y - m_cube_bounds.y };
-        const Vector2 mouse_in_view_prc = { mouse_in_view.x / m_cube_bounds.width,
-            mouse_in_view.y / m_cube_bounds.height };
-        const Vector2 mouse_in_view_real = {
-            m_render_tex_dims.x * mouse_in_view_prc.x,
-            m_render_tex_dims.y * mouse_in_view_prc.y
-        };
-        const auto ray = GetScreenToWorldRayEx(
-            mouse_in_view_real, m_camera, m_render_tex_dims.x, m_render_tex_dims.y);
-        const auto collision = GetRayCollisionBox(ray, bbox);
-        if (!collision.hit) {
-            return;
-        }
-        tooltip_info = { x, y, z };
-    };
     static Vector2 last_mouse_pos = { -1, -1 };
     static double mouse_stationary_time = 0.0;
     const auto mouse = GetMousePosition();
@@ -157,80 +237,87 @@ void boot::EditorWindow::draw(Game& game_state)
     DrawRectangleGradientEx(m_bounds, RED, BLUE, RED, BLUE);
     this->m_text_buffer->draw();
     this->m_output_buffer->draw();
+    const int layer = cube.y * m_slider.get_percentage() + 1;
+    // the geometry does not depend on the layer, moving the slider only changes what is drawn
+    if (update_voxel_geometry(game_state) || layer != m_drawn_layer)
+        m_scene_dirty = true;
+    m_drawn_layer = layer;
+    // the tooltip is drawn on top of the render texture, hovering never dirties the scene
+    const auto tooltip_info = pick_voxel(game_state, layer);
+    if (m_scene_dirty) {
+        const auto render_start = GetTime();
+        render_scene(game_state, layer);
+        m_scene_render_time += GetTime() - render_start;
+        m_scene_dirty = false;
+        m_scene_renders++;
+    }
+    if (const auto now = GetTime(); now - m_scene_renders_since >= 1.0) {
+        m_scene_renders_per_second = m_scene_renders / (now - m_scene_renders_since);
+        // the time it takes the CPU to submit the scene, the GPU finishes it asynchronously
+        if (m_scene_renders)
+            TraceLog(LOG_DEBUG, "Scene re-renders: %.1f/s, %.3f ms each (%dx%dx%d voxels)",
+                m_scene_renders_per_second, m_scene_render_time * 1000. / m_scene_renders,
+                cube.x, cube.y, cube.z);
+        m_scene_renders = 0;
+        m_scene_render_time = 0;
+        m_scene_renders_since = now;
+    }
+    // only the part of the texture the last render used
+    Rectangle src = {
+        .x = 0,
+        .y = 0,
+        .width = m_rendered_dims.x,
+        .height = -m_rendered_dims.y,
+    };
+    DrawTexturePro(m_render_tex.texture, src, m_cube_bounds, Vector2Zero(), 0,
+        WHITE);
+    this->m_slider.draw();
+    // keep drawing until the tooltip shows up
+    if (tooltip_info && GetTime() < mouse_stationary_time)
+        request_redraw();
+    if (tooltip_info && GetTime() >= mouse_stationary_time) {
+        const auto hex = [](Color c) {
+            return std::format("#{:02X}{:02X}{:02X}", c.r, c.g, c.b);
+        };
+        const auto& [x, y, z, look, color, expected] = *tooltip_info;
+        std::string txt = std::format("({},{},{}) ", x, y, z);
+        switch (look) {
+        case VoxelLook::Solid:
+            txt += hex(color);
+            break;
+        case VoxelLook::WrongColor:
+            txt += std::format("{} instead of {}", hex(color), hex(expected));
+            break;
+        case VoxelLook::Missing:
+            txt += std::format("missing {}", hex(expected));
+            break;
+        case VoxelLook::Hidden:
+            break;
+        }
+        boot::draw_cursor_tooltip(txt.c_str(), game_state.font, 20, 10, m_bounds,
+            BLACK);
+    }
+}
+double boot::EditorWindow::get_scene_renders_per_second(void) const
+{
+    return m_scene_renders_per_second;
+}
+void boot::EditorWindow::render_scene(Game& game_state, int layer)
+{
+    const auto& cube = game_state.cube;
     BeginTextureMode(m_render_tex);
+    // dynamic resolution renders into the lower left part of the texture while the camera
+    // moves, the aspect ratio stays the same
+    const float scale = m_camera_moving ? m_moving_render_scale : 1.f;
+    m_rendered_dims = {
+        std::max(1.f, std::round(m_render_tex_dims.x * scale)),
+        std::max(1.f, std::round(m_render_tex_dims.y * scale)),
+    };
+    rlViewport(0, 0, m_rendered_dims.x, m_rendered_dims.y);
     BeginBlendMode(BLEND_ALPHA);
     ClearBackground(WHITE);
     BeginMode3D(m_camera);
-    const int layer = cube.y * m_slider.get_percentage() + 1;
-    for (int x = 0; x < cube.x; x++) {
-        for (int y = 0; y < cube.y && y < layer; y++) {
-            for (int z = 0; z < cube.z; z++) {
-                auto nx = x - ((cube.x - 1) * brick_width / 2);
-                auto nz = z - ((cube.z - 1) * brick_width / 2);
-                auto ny = y + brick_width / 2;
-                Color c = game_state.color_for(x, y, z);
-                Vector3 pos = (Vector3) { (float)nx, (float)ny, (float)nz };
-
-                if (c.a == 255) {
-                    if (game_state.get_lvl_data()) {
-                        const auto s = game_state.get_lvl_data()->solution->color_data[x][y][z];
-                        if ((c.r != s.r || c.g != s.g || c.b != s.b) && s.a != 0 && c.a != 0) {
-                            DrawCube(pos, solution_brick_width, solution_brick_width,
-                                solution_brick_width, RED);
-                            draw_solution_tooltip(x, y, z, pos);
-                        } else {
-                            DrawCube(pos, brick_width, brick_width, brick_width, c);
-                        }
-                    } else {
-                        DrawCube(pos, brick_width, brick_width, brick_width, c);
-                    }
-                } else if (game_state.get_lvl_data()) {
-                    const auto scolor = game_state.get_lvl_data()->solution->color_data[x][y][z];
-                    if (scolor.a) {
-                        DrawCube(pos, solution_brick_width, solution_brick_width,
-                            solution_brick_width, { scolor.r, scolor.g, scolor.b, 255 });
-                        draw_solution_tooltip(x, y, z, pos);
-                    }
-                }
-                // drawing of the grid numbers
-                std::string str = "";
-                int csz = 1;
-                if (y == 0 && z == 0) {
-                    str = std::format("{}", x);
-                    auto sz = boot::measure_text_3d(str.c_str(), game_state.font, 0.8, 0.2);
-                    auto mark_pos = pos;
-                    mark_pos.x -= sz.x / 2;
-                    mark_pos.y = 0;
-                    mark_pos.z -= sz.y * 2;
-                    boot::draw_text_3d(str.c_str(), game_state.font, mark_pos, 0.8, 0.2,
-                        boot::colors::X_AXIS, false,
-                        Rotation::x_axis(-90));
-                }
-                if (y == 0 && x == 0) {
-                    str = std::format("{}", z);
-                    auto sz = boot::measure_text_3d(str.c_str(), game_state.font, 0.8, 0.2);
-                    auto mark_pos = pos;
-                    mark_pos.x -= sz.y * 2;
-                    mark_pos.y = 0;
-                    mark_pos.z -= sz.x / 2;
-                    boot::draw_text_3d(str.c_str(), game_state.font, mark_pos, 0.8, 0.2,
-                        boot::colors::Z_AXIS, false,
-                        Rotation::x_axis(-90));
-                }
-                if (z == 0 && x == 0) {
-                    str = std::format("{}", y);
-                    auto sz = boot::measure_text_3d(str.c_str(), game_state.font, 0.8, 0.2);
-                    auto mark_pos = pos;
-                    mark_pos.y += sz.y / 2;
-                    mark_pos.x -= brick_width + sz.x / 2;
-                    mark_pos.z -= brick_width;
-                    boot::draw_text_3d(str.c_str(), game_state.font, mark_pos, 0.8, 0.2,
-                        boot::colors::Y_AXIS, false,
-                        Rotation::y_axis(45));
-                }
-            }
-        }
-    }
+    m_voxel_renderer.draw(layer);
     DrawGrid(5, 5);
     constexpr const auto axis_len = 20;
     const Vector3 axis_center = { -2 * 5., 0, -2 * 5. };
@@ -240,46 +327,182 @@ void boot::EditorWindow::draw(Game& game_state)
         boot::colors::Y_AXIS);
     DrawLine3D(axis_center, Vector3Add(axis_center, { 0, 0, axis_len }),
         boot::colors::Z_AXIS);
-
+    // the y labels come last in the label mesh, the ones above the layer are cut off
+    update_label_mesh(game_state);
+    const int visible_y_labels = std::clamp(layer, 0, cube.y);
+    m_label_mesh.draw(m_label_y_vertices[visible_y_labels]);
+    EndMode3D();
+    EndBlendMode();
+    EndTextureMode();
+}
+void boot::EditorWindow::update_label_mesh(Game& game_state)
+{
+    const auto& cube = game_state.cube;
+    const std::array<int, 4> key = { cube.x, cube.y, cube.z, static_cast<int>(game_state.font.texture.id) };
+    if (key == m_label_key)
+        return;
+    m_label_key = key;
+    const auto brick_width = 1.0f;
+    const auto voxel_pos = [&](int x, int y, int z) {
+        auto nx = x - ((cube.x - 1) * brick_width / 2);
+        auto nz = z - ((cube.z - 1) * brick_width / 2);
+        auto ny = y + brick_width / 2;
+        return (Vector3) { (float)nx, (float)ny, (float)nz };
+    };
+    m_label_mesh.clear(game_state.font);
+    // the grid numbers
+    for (int x = 0; x < cube.x; x++) {
+        const auto str = std::format("{}", x);
+        auto sz = boot::measure_text_3d(str.c_str(), game_state.font, 0.8, 0.2);
+        auto mark_pos = voxel_pos(x, 0, 0);
+        mark_pos.x -= sz.x / 2;
+        mark_pos.y = 0;
+        mark_pos.z -= sz.y * 2;
+        m_label_mesh.append_text(str.c_str(), mark_pos, 0.8, 0.2,
+            boot::colors::X_AXIS, false,
+            Rotation::x_axis(-90));
+    }
+    for (int z = 0; z < cube.z; z++) {
+        const auto str = std::format("{}", z);
+        auto sz = boot::measure_text_3d(str.c_str(), game_state.font, 0.8, 0.2);
+        auto mark_pos = voxel_pos(0, 0, z);
+        mark_pos.x -= sz.y * 2;
+        mark_pos.y = 0;
+        mark_pos.z -= sz.x / 2;
+        m_label_mesh.append_text(str.c_str(), mark_pos, 0.8, 0.2,
+            boot::colors::Z_AXIS, false,
+            Rotation::x_axis(-90));
+    }
+    // the axis marks
+    constexpr const auto axis_len = 20;
+    const Vector3 axis_center = { -2 * 5., 0, -2 * 5. };
     constexpr const auto axis_mark_size = 5;
     int csz = 1;
     int c = GetCodepoint("X", &csz);
     auto sz = boot::measure_codepoint_3d(c, game_state.font, axis_mark_size);
-    boot::draw_codepoint_3d(
-        c, game_state.font,
-        { axis_center.x + axis_len - sz.x, axis_center.y + sz.y, axis_center.z },
+    m_label_mesh.append_codepoint(
+        c, { axis_center.x + axis_len - sz.x, axis_center.y + sz.y, axis_center.z },
         axis_mark_size, boot::colors::X_AXIS, false);
     c = GetCodepoint("Z", &csz);
     sz = boot::measure_codepoint_3d(c, game_state.font, axis_mark_size);
-    boot::draw_codepoint_3d(
-        c, game_state.font,
-        { axis_center.x, axis_center.y + sz.y, axis_center.z + axis_len },
+    m_label_mesh.append_codepoint(
+        c, { axis_center.x, axis_center.y + sz.y, axis_center.z + axis_len },
         axis_mark_size, boot::colors::Z_AXIS, false, Rotation::y_axis(90));
     c = GetCodepoint("Y", &csz);
     sz = boot::measure_codepoint_3d(c, game_state.font, axis_mark_size);
-    boot::draw_codepoint_3d(
-        c, game_state.font,
-        { axis_center.x + 0.5f, axis_center.y + axis_len, axis_center.z },
+    m_label_mesh.append_codepoint(
+        c, { axis_center.x + 0.5f, axis_center.y + axis_len, axis_center.z },
         axis_mark_size, boot::colors::Y_AXIS, false, Rotation::none());
+    // the y numbers, m_label_y_vertices[n] is where the first n of them end
+    m_label_y_vertices.assign(1, m_label_mesh.vertex_count());
+    for (int y = 0; y < cube.y; y++) {
+        const auto str = std::format("{}", y);
+        auto sz = boot::measure_text_3d(str.c_str(), game_state.font, 0.8, 0.2);
+        auto mark_pos = voxel_pos(0, y, 0);
+        mark_pos.y += sz.y / 2;
+        mark_pos.x -= brick_width + sz.x / 2;
+        mark_pos.z -= brick_width;
+        m_label_mesh.append_text(str.c_str(), mark_pos, 0.8, 0.2,
+            boot::colors::Y_AXIS, false,
+            Rotation::y_axis(45));
+        m_label_y_vertices.push_back(m_label_mesh.vertex_count());
+    }
+    m_label_mesh.upload();
+}
+bool boot::EditorWindow::update_voxel_geometry(Game& game_state)
+{
+    if (game_state.get_cube_version() == m_drawn_cube_version)
+        return false;
+    const auto start_time = GetTime();
+    m_drawn_cube_version = game_state.get_cube_version();
+    const auto& cube = game_state.cube;
+    const auto brick_width = 1.0f;
+    const auto solution_brick_width = brick_width / 3;
+    const auto& lvl_data = game_state.get_lvl_data();
+    const CubeData* solution = lvl_data ? &lvl_data->solution.value() : nullptr;
+    const auto& census = game_state.get_census();
+    const auto voxel_pos = [&](int x, int y, int z) {
+        auto nx = x - ((cube.x - 1) * brick_width / 2);
+        auto nz = z - ((cube.z - 1) * brick_width / 2);
+        auto ny = y + brick_width / 2;
+        return (Vector3) { (float)nx, (float)ny, (float)nz };
+    };
+    m_voxel_instances.clear();
+    std::vector<size_t> layer_ends(std::max(cube.y, 0));
+    const auto add_marker = [&](int x, int y, int z, Color color) {
+        m_voxel_instances.push_back({ .position = voxel_pos(x, y, z), .scale = solution_brick_width, .color = color });
+        layer_ends[y]++;
+    };
+    // markers only exist in the bricks with mismatches
+    for (size_t b = 0; b < cube.brick_count(); b++) {
+        if (!(census && census->brick_has_mismatches(b)))
+            continue;
+        const auto origin = cube.brick_origin(b);
+        const int x_end = std::min(origin.x + CubeData::BRICK_EDGE, cube.x);
+        const int y_end = std::min(origin.y + CubeData::BRICK_EDGE, cube.y);
+        const int z_end = std::min(origin.z + CubeData::BRICK_EDGE, cube.z);
+        for (int x = origin.x; x < x_end; x++) {
+            for (int y = origin.y; y < y_end; y++) {
+                for (int z = origin.z; z < z_end; z++) {
+                    const auto look = look_of(cube, solution, census, x, y, z);
+                    if (look == VoxelLook::WrongColor) {
+                        add_marker(x, y, z, RED);
+                    } else if (look == VoxelLook::Missing) {
+                        const auto scolor = solution->get(x, y, z);
+                        add_marker(x, y, z, { scolor.r, scolor.g, scolor.b, 255 });
+                    }
+                }
+            }
+        }
+    }
+    // sorted by layer the instances below the layer slider are a prefix of the buffer
+    std::stable_sort(m_voxel_instances.begin(), m_voxel_instances.end(),
+        [](const auto& a, const auto& b) { return a.position.y < b.position.y; });
+    for (size_t y = 1; y < layer_ends.size(); y++)
+        layer_ends[y] += layer_ends[y - 1];
+    m_voxel_renderer.set_instances(m_voxel_instances, std::move(layer_ends));
 
-    EndMode3D();
-    EndBlendMode();
-    EndTextureMode();
-    Rectangle src = {
-        .x = 0,
-        .y = 0,
-        .width = m_render_tex_dims.x,
-        .height = -m_render_tex_dims.y,
+    const auto solid = [&](int x, int y, int z) -> uint32_t {
+        if (x < 0 || y < 0 || z < 0 || x >= cube.x || y >= cube.y || z >= cube.z)
+            return 0;
+        if (look_of(cube, solution, census, x, y, z) != VoxelLook::Solid)
+            return 0;
+        return cube.get_packed(x, y, z);
     };
-    DrawTexturePro(m_render_tex.texture, src, m_cube_bounds, Vector2Zero(), 0,
-        WHITE);
-    this->m_slider.draw();
-    if (tooltip_info && GetTime() >= mouse_stationary_time) {
-        const auto txt = std::format("({},{},{})", std::get<0>(*tooltip_info),
-            std::get<1>(*tooltip_info), std::get<2>(*tooltip_info));
-        boot::draw_cursor_tooltip(txt.c_str(), game_state.font, 20, 10, m_bounds,
-            BLACK);
+    if (m_chunk_hashes.size() != cube.brick_count()) {
+        m_chunk_hashes.assign(cube.brick_count(), 0);
+        m_voxel_renderer.set_chunk_count(cube.brick_count());
+    }
+    // the dimensions move the origin of the mesh around so they are part of every hash
+    const uint64_t dims_seed = (static_cast<uint64_t>(cube.x) << 42)
+        ^ (static_cast<uint64_t>(cube.y) << 21) ^ static_cast<uint64_t>(cube.z);
+    const Vector3 mesh_origin = { -cube.x * brick_width / 2, 0, -cube.z * brick_width / 2 };
+    size_t remeshed = 0;
+    for (size_t b = 0; b < cube.brick_count(); b++) {
+        const auto origin = cube.brick_origin(b);
+        const std::array<int, 3> min = { origin.x, origin.y, origin.z };
+        const std::array<int, 3> max = {
+            std::min(origin.x + CubeData::BRICK_EDGE, cube.x),
+            std::min(origin.y + CubeData::BRICK_EDGE, cube.y),
+            std::min(origin.z + CubeData::BRICK_EDGE, cube.z),
+        };
+        // an empty brick has nothing to mesh, whatever its neighbours hold
+        const uint64_t hash = cube.has_brick(b) && max[1] > min[1]
+            ? boot::hash_mesh_region(min, max, dims_seed, solid)
+            : 0;
+        if (hash == m_chunk_hashes[b])
+            continue;
+        m_chunk_hashes[b] = hash;
+        m_voxel_mesh.clear();
+        if (hash)
+            boot::greedy_mesh_layers(min, max, mesh_origin, solid, m_voxel_mesh);
+        m_voxel_renderer.set_chunk_mesh(b, m_voxel_mesh);
+        remeshed++;
     }
+    TraceLog(LOG_DEBUG, "Re-meshed %zu of %zu voxel chunks (%zu vertices) and rebuilt %zu voxel instances in %.3f ms",
+        remeshed, cube.brick_count(), m_voxel_renderer.get_mesh_vertex_count(),
+        m_voxel_instances.size(), (GetTime() - start_time) * 1000.);
+    return true;
 }
 const char* boot::EditorWindow::get_window_name()
 {
@@ -301,11 +524,14 @@ void boot::EditorWindow::on_config_reload(const Config& conf)
         if (conf.syntax_highlighting) {
             auto ps = std::bind(process_syntax, conf.foreground_color,
                 std::placeholders::_1, std::placeholders::_2,
-                std::placeholders::_3);
+                std::placeholders::_3, std::placeholders::_4);
             m_text_buffer->set_syntax_parser(ps);
         } else
             m_text_buffer->set_syntax_parser(nullptr);
     }
+    m_moving_render_scale = std::clamp(conf.moving_render_scale, 0.1f, 1.f);
+    // the labels of the scene use the game font, which may have been reloaded
+    m_scene_dirty = true;
 }
 void boot::EditorWindow::on_transition(Game& game_state)
 {
@@ -313,6 +539,7 @@ void boot::EditorWindow::on_transition(Game& game_state)
         m_output_buffer->clear();
     }
     m_slider.set_value(m_slider.get_max());
+    m_scene_dirty = true;
 }
 
 namespace tokens {
@@ -363,10 +590,11 @@ static bool hex_dig_check(char c)
     };
 };
 
-static void process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
-    buffer_t::text_buffer_iterator tit,
+static buffer_t::syntax_state_t process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
+    buffer_t::syntax_state_t, buffer_t::text_buffer_iterator tit,
     const buffer_t::text_buffer_iterator end)
 {
+    // nothing spans lines, every line starts and ends with no state
     std::string buf;
     buf.reserve(20);
     buffer_t::Cursor pos = tit.current_cursor_pos();
@@ -379,7 +607,7 @@ static void process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
         switch (c) {
         case '(':
         case ')':
-            syntax[pos] = tokens::ROUND_PAREN;
+            syntax.append(pos, tokens::ROUND_PAREN);
             break;
         case '.':
             dig_has_dot = true;
@@ -399,11 +627,11 @@ static void process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
         case '8':
         case '9':
         case '0':
-            syntax[pos] = tokens::DIGIT;
+            syntax.append(pos, tokens::DIGIT);
             for (; tit != end; tit++) {
                 const auto ch = *tit;
                 if (ch == '.' && dig_has_dot) {
-                    syntax[pos] = foreground;
+                    syntax.append(pos, foreground);
                     break;
                 }
                 dig_has_dot = ch == '.';
@@ -423,7 +651,7 @@ static void process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
         case ' ':
         case '\t':
         case '\n':
-            syntax[pos] = foreground;
+            syntax.append(pos, foreground);
             break;
             // clang-format off
         case 97: case 98: case 99: case 100:
@@ -441,22 +669,23 @@ static void process_syntax(Color foreground, buffer_t::syntax_data_t& syntax,
         case 87: case 88: case 89: case 90:
         // clang-format on
         case '_':
-            syntax[pos] = foreground;
+            syntax.append(pos, foreground);
             buf.clear();
             for (; tit != end; tit++) {
                 const auto ch = *tit;
                 if ((std::isspace(ch) || !std::isalnum(ch) || ch == '\n') && ch != '_') {
-                    syntax[pos] = match_literal(buf).value_or(foreground);
+                    syntax.append(pos, match_literal(buf).value_or(foreground));
                     goto skip_pos_increment;
                 }
                 buf.push_back(ch);
             }
             break;
         default:
-            syntax[pos] = foreground;
+            syntax.append(pos, foreground);
             break;
         }
         tit++;
     skip_pos_increment:
     }
+    return {};
 }
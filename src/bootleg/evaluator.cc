@@ -0,0 +1,714 @@
+#include "defer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <bootleg/evaluator.hpp>
+#include <bootleg/game.hpp>
+#include <bootleg/lua_generics.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __cplusplus
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+}
+#endif
+
+static void setup_colors(lua_State* lua)
+{
+    const auto add_color = [=](const std::string_view name, const Color& col) {
+        unsigned char hex[4] = {};
+        hex[3] = col.r;
+        hex[2] = col.g;
+        hex[1] = col.b;
+        hex[0] = col.a;
+        boot::lua::setglobalv(lua, name.data(),
+            *reinterpret_cast<unsigned int*>(&hex));
+    };
+    for (const auto& [k, v] : boot::colors::COLORMAP) {
+        add_color(k, v);
+    }
+}
+extern "C" {
+static int l_color__from_parts(lua_State* L)
+{
+    int n = lua_gettop(L);
+    if (n != 3)
+        return 0;
+    const bool all_nums = lua_isnumber(L, 1) && lua_isnumber(L, 2) && lua_isnumber(L, 3);
+    if (!all_nums)
+        return 0;
+    constexpr const auto max = std::numeric_limits<decltype(Color::a)>::max();
+    Color color = {};
+    color.a = max;
+    color.r = std::abs(lua_tonumber(L, 1)) * max;
+    color.g = std::abs(lua_tonumber(L, 2)) * max;
+    color.b = std::abs(lua_tonumber(L, 3)) * max;
+    int32_t raw_color = 0;
+    int8_t* bytes = reinterpret_cast<int8_t*>(&raw_color);
+    bytes[3] = color.r;
+    bytes[2] = color.g;
+    bytes[1] = color.b;
+    bytes[0] = color.a;
+    lua_pushinteger(L, raw_color);
+    return 1;
+}
+static int l_panic(lua_State* L)
+{
+    const char* msg = lua_tostring(L, -1);
+    std::fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg ? msg : "unknown error");
+    return 0;
+}
+}
+namespace boot {
+LuaAllocStats& LuaAllocStats::operator+=(const LuaAllocStats& other)
+{
+    allocations += other.allocations;
+    reallocations += other.reallocations;
+    frees += other.frees;
+    pool_hits += other.pool_hits;
+    bytes_in_use += other.bytes_in_use;
+    peak_bytes += other.peak_bytes;
+    pool_bytes += other.pool_bytes;
+    return *this;
+}
+void LuaPoolAllocator::ChunkDeleter::operator()(std::byte* chunk) const
+{
+    std::free(chunk);
+}
+LuaPoolAllocator::ChunkHeader* LuaPoolAllocator::chunk_of(const void* block)
+{
+    return reinterpret_cast<ChunkHeader*>(reinterpret_cast<uintptr_t>(block) & ~(CHUNK_SIZE - 1));
+}
+void* LuaPoolAllocator::alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    auto* self = static_cast<LuaPoolAllocator*>(ud);
+    // lua expects NULL when an allocation fails, an exception would unwind through its C frames
+    try {
+        return self->reallocate(ptr, osize, nsize);
+    } catch (const std::bad_alloc&) {
+        return NULL;
+    }
+}
+void* LuaPoolAllocator::reallocate(void* ptr, size_t osize, size_t nsize)
+{
+    if (nsize == 0) {
+        if (ptr)
+            deallocate(ptr, osize);
+        return NULL;
+    }
+    // when ptr is null osize holds the type of the object, not a size
+    if (!ptr)
+        return allocate(nsize);
+    const auto same_class = (osize + GRANULE - 1) / GRANULE == (nsize + GRANULE - 1) / GRANULE;
+    if (osize <= MAX_POOLED && nsize <= MAX_POOLED && same_class) {
+        m_stats.reallocations++;
+        m_stats.bytes_in_use += nsize;
+        m_stats.bytes_in_use -= osize;
+        m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.bytes_in_use);
+        return ptr;
+    }
+    if (osize > MAX_POOLED && nsize > MAX_POOLED) {
+        void* block = std::realloc(ptr, nsize);
+        if (!block)
+            return NULL;
+        m_stats.reallocations++;
+        m_stats.bytes_in_use += nsize;
+        m_stats.bytes_in_use -= osize;
+        m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.bytes_in_use);
+        return block;
+    }
+    // moving between the pool and the system allocator, counted as an allocation and a free
+    void* block = allocate(nsize);
+    if (!block)
+        return NULL;
+    std::memcpy(block, ptr, std::min(osize, nsize));
+    deallocate(ptr, osize);
+    return block;
+}
+void* LuaPoolAllocator::allocate(size_t size)
+{
+    void* block = NULL;
+    if (size > MAX_POOLED) {
+        block = std::malloc(size);
+    } else {
+        const size_t cls = (size - 1) / GRANULE;
+        const size_t block_size = (cls + 1) * GRANULE;
+        if (auto* head = m_free_lists[cls]; head) {
+            m_free_lists[cls] = head->next;
+            m_stats.pool_hits++;
+            block = head;
+        } else {
+            if (static_cast<size_t>(m_chunk_end - m_cursor) < block_size) {
+                // the tail of the previous chunk is too small for this class, it is dropped
+                auto chunk = std::unique_ptr<std::byte[], ChunkDeleter>(
+                    static_cast<std::byte*>(std::aligned_alloc(CHUNK_SIZE, CHUNK_SIZE)));
+                if (!chunk)
+                    return NULL;
+                new (chunk.get()) ChunkHeader {};
+                m_chunks.push_back(std::move(chunk));
+                m_cursor = m_chunks.back().get() + GRANULE;
+                m_chunk_end = m_chunks.back().get() + CHUNK_SIZE;
+                m_stats.pool_bytes += CHUNK_SIZE;
+            }
+            block = m_cursor;
+            m_cursor += block_size;
+        }
+        chunk_of(block)->live++;
+    }
+    if (!block)
+        return NULL;
+    m_stats.allocations++;
+    m_stats.bytes_in_use += size;
+    m_stats.peak_bytes = std::max(m_stats.peak_bytes, m_stats.bytes_in_use);
+    return block;
+}
+void LuaPoolAllocator::deallocate(void* ptr, size_t size)
+{
+    m_stats.frees++;
+    m_stats.bytes_in_use -= size;
+    if (size > MAX_POOLED) {
+        std::free(ptr);
+        return;
+    }
+    const size_t cls = (size - 1) / GRANULE;
+    auto* block = static_cast<FreeBlock*>(ptr);
+    block->next = m_free_lists[cls];
+    m_free_lists[cls] = block;
+    chunk_of(block)->live--;
+}
+const LuaAllocStats& LuaPoolAllocator::get_stats(void) const
+{
+    return m_stats;
+}
+size_t LuaPoolAllocator::trim(void)
+{
+    const auto unused = [](const void* block) {
+        return chunk_of(block)->live == 0;
+    };
+    if (std::ranges::none_of(m_chunks, [&](const auto& chunk) { return unused(chunk.get()); }))
+        return 0;
+    for (auto& head : m_free_lists) {
+        FreeBlock** link = &head;
+        while (*link) {
+            if (unused(*link))
+                *link = (*link)->next;
+            else
+                link = &(*link)->next;
+        }
+    }
+    if (m_chunk_end && unused(m_cursor - 1)) {
+        m_cursor = NULL;
+        m_chunk_end = NULL;
+    }
+    const auto released = std::erase_if(m_chunks, [&](const auto& chunk) { return unused(chunk.get()); });
+    m_stats.pool_bytes -= released * CHUNK_SIZE;
+    return released * CHUNK_SIZE;
+}
+void LuaPoolAllocator::reset_stats(void)
+{
+    m_stats = LuaAllocStats {
+        .bytes_in_use = m_stats.bytes_in_use,
+        .peak_bytes = m_stats.bytes_in_use,
+        .pool_bytes = m_stats.pool_bytes,
+    };
+}
+
+lua_State* new_sandboxed_lua_state(void)
+{
+    return new_sandboxed_lua_state(NULL, NULL);
+}
+lua_State* new_sandboxed_lua_state(lua_Alloc alloc, void* ud)
+{
+    lua_State* L = alloc ? lua_newstate(alloc, ud) : luaL_newstate();
+    if (alloc)
+        lua_atpanic(L, l_panic);
+    luaL_openlibs(L);
+    lua::setglobalv(L, "io", LUA_TNIL);
+    lua::setglobalv(L, "table", LUA_TNIL);
+    lua::setglobalv(L, "string", LUA_TNIL);
+    lua::setglobalv(L, "os", LUA_TNIL);
+    lua::setglobalv(L, "debug", LUA_TNIL);
+    lua::setglobalv(L, "print", LUA_TNIL);
+
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "fromRGB");
+    lua_pushcfunction(L, l_color__from_parts);
+    lua_settable(L, 1);
+    lua_setglobal(L, "color");
+    lua::setglobalv(L, "x", 0);
+    lua::setglobalv(L, "y", 0);
+    lua::setglobalv(L, "z", 0);
+    lua::setglobalv(L, "Color", 0);
+    setup_colors(L);
+    lua_settop(L, 0);
+    return L;
+}
+
+namespace {
+    /// stores a copy of the table at `idx` in the table at `shared`, under the table itself
+    /// as the key, the copy gets the metatable of the original
+    void snapshot_table(lua_State* L, int shared, int idx)
+    {
+        shared = lua_absindex(L, shared);
+        idx = lua_absindex(L, idx);
+        lua_pushvalue(L, idx);
+        if (lua_rawget(L, shared) != LUA_TNIL) {
+            lua_pop(L, 1);
+            return;
+        }
+        lua_pop(L, 1);
+        lua_pushvalue(L, idx);
+        lua_createtable(L, 0, 0);
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, -4);
+        }
+        if (lua_getmetatable(L, idx))
+            lua_setmetatable(L, -2);
+        lua_rawset(L, shared);
+    }
+    /// makes the contents and the metatable of the table at `idx` match `copy` again
+    void restore_table(lua_State* L, int idx, int copy)
+    {
+        idx = lua_absindex(L, idx);
+        copy = lua_absindex(L, copy);
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+            lua_pushvalue(L, -2);
+            lua_rawget(L, copy);
+            const bool same = lua_rawequal(L, -1, -2);
+            lua_pop(L, 2);
+            // clearing fields that already exist is allowed while traversing
+            if (!same) {
+                lua_pushvalue(L, -1);
+                lua_pushnil(L);
+                lua_rawset(L, idx);
+            }
+        }
+        lua_pushnil(L);
+        while (lua_next(L, copy)) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, idx);
+        }
+        if (!lua_getmetatable(L, copy))
+            lua_pushnil(L);
+        lua_setmetatable(L, idx);
+    }
+}
+LuaSandbox::LuaSandbox()
+    : m_L(new_sandboxed_lua_state(LuaPoolAllocator::alloc, &m_allocator))
+{
+    // the globals, the libraries in them and the string metatable with the string library
+    // are shared between runs
+    lua_createtable(m_L, 0, 0);
+    const int shared = lua_gettop(m_L);
+    lua_pushglobaltable(m_L);
+    snapshot_table(m_L, shared, -1);
+    lua_pushnil(m_L);
+    while (lua_next(m_L, -2)) {
+        if (lua_istable(m_L, -1))
+            snapshot_table(m_L, shared, -1);
+        lua_pop(m_L, 1);
+    }
+    lua_pop(m_L, 1);
+    lua_pushstring(m_L, "");
+    if (lua_getmetatable(m_L, -1)) {
+        snapshot_table(m_L, shared, -1);
+        if (lua_getfield(m_L, -1, "__index") == LUA_TTABLE)
+            snapshot_table(m_L, shared, -1);
+        lua_pop(m_L, 2);
+    }
+    lua_pop(m_L, 1);
+    m_shared_ref = luaL_ref(m_L, LUA_REGISTRYINDEX);
+    // env = setmetatable({}, { __index = _G, __metatable = false }), the protected metatable
+    // keeps scripts from removing it or reaching the shared globals through it
+    lua_createtable(m_L, 0, 2);
+    lua_pushglobaltable(m_L);
+    lua_setfield(m_L, -2, "__index");
+    lua_pushboolean(m_L, false);
+    lua_setfield(m_L, -2, "__metatable");
+    m_env_meta_ref = luaL_ref(m_L, LUA_REGISTRYINDEX);
+    lua_createtable(m_L, 0, 0);
+    m_env_ref = luaL_ref(m_L, LUA_REGISTRYINDEX);
+    reset();
+}
+LuaSandbox::~LuaSandbox()
+{
+    lua_close(m_L);
+}
+lua_State* LuaSandbox::get_state(void) const
+{
+    return m_L;
+}
+const LuaAllocStats& LuaSandbox::get_alloc_stats(void) const
+{
+    return m_allocator.get_stats();
+}
+void LuaSandbox::reset_alloc_stats(void)
+{
+    m_allocator.reset_stats();
+}
+size_t LuaSandbox::reset(void)
+{
+    lua_settop(m_L, 0);
+    lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_env_ref);
+    size_t cleared = 0;
+    lua_pushnil(m_L);
+    while (lua_next(m_L, 1)) {
+        // clearing fields that already exist is allowed while traversing
+        lua_pop(m_L, 1);
+        lua_pushvalue(m_L, -1);
+        lua_pushnil(m_L);
+        lua_rawset(m_L, 1);
+        cleared++;
+    }
+    // _G has to point at the environment or scripts could write into the shared globals
+    lua_pushstring(m_L, "_G");
+    lua_pushvalue(m_L, 1);
+    lua_rawset(m_L, 1);
+    lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_env_meta_ref);
+    lua_setmetatable(m_L, 1);
+    // scripts can still change the shared tables directly (`math.floor = nil`)
+    lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_shared_ref);
+    lua_pushnil(m_L);
+    while (lua_next(m_L, 2)) {
+        restore_table(m_L, -2, -1);
+        lua_pop(m_L, 1);
+    }
+    lua_settop(m_L, 0);
+    // the chunks that only held what the previous run left behind go back to the system
+    lua_gc(m_L, LUA_GCCOLLECT);
+    m_allocator.trim();
+    return cleared;
+}
+int LuaSandbox::load(std::string_view source, const char* chunk_name)
+{
+    const auto status = luaL_loadbuffer(m_L, source.data(), source.size(), chunk_name);
+    if (status != LUA_OK)
+        return status;
+    // the first upvalue of a main chunk is always _ENV
+    lua_rawgeti(m_L, LUA_REGISTRYINDEX, m_env_ref);
+    lua_setupvalue(m_L, -2, 1);
+    return status;
+}
+std::optional<std::string> LuaSandbox::run(std::string_view source, const char* chunk_name)
+{
+    if (load(source, chunk_name) != LUA_OK || lua_pcall(m_L, 0, 0, 0) != LUA_OK) {
+        const auto* msg = lua_tostring(m_L, -1);
+        auto error = std::string(msg ? msg : "unknown error");
+        lua_settop(m_L, 0);
+        return error;
+    }
+    lua_settop(m_L, 0);
+    return std::nullopt;
+}
+
+std::string wrap_player_source(std::string_view source)
+{
+    // everything up to the player's code stays on the first line so that line numbers in
+    // error messages still match the editor
+    return std::format("local x, y, z, X, Y, Z, Color "
+                       "local function __bootleg_body(...) {}\n"
+                       "end "
+                       "return function(_x, _y, _z, _X, _Y, _Z) "
+                       "x, y, z, X, Y, Z, Color = _x, _y, _z, _X, _Y, _Z, 0 "
+                       "__bootleg_body() "
+                       "return Color "
+                       "end",
+        source);
+}
+std::string wrap_level_source(std::string_view source)
+{
+    // X, Y, Z are set by the level itself so they stay globals
+    return std::format("local x, y, z, Color = 0, 0, 0, 0 "
+                       "local function __bootleg_level(...) {}\n"
+                       "end "
+                       "__bootleg_level() "
+                       "local Generate = Generate "
+                       "if type(Generate) ~= 'function' then "
+                       "error(\"Lua function 'Generate' does not exist\", 0) "
+                       "end "
+                       "return function(_x, _y, _z) "
+                       "x, y, z, Color = _x, _y, _z, 0 "
+                       "Generate() "
+                       "return Color "
+                       "end",
+        source);
+}
+
+namespace {
+    /// how many lua instructions run between budget checks
+    constexpr const int BUDGET_CHECK_INTERVAL = 1000;
+    enum class Abort {
+        NONE,
+        CANCELLED,
+        INSTRUCTIONS,
+        TIME,
+    };
+    /// shared by all the slabs of one evaluation
+    struct Budget {
+        std::atomic<uint64_t> instructions {};
+        uint64_t instruction_limit {};
+        std::optional<std::chrono::steady_clock::time_point> deadline {};
+    };
+    /// pointed to by the extra space of a lua state for the duration of a slab evaluation
+    struct SlabContext {
+        Budget* budget {};
+        std::stop_token stop {};
+        Abort abort = Abort::NONE;
+    };
+    struct SlabResult {
+        std::optional<std::string> error {};
+        size_t error_index = std::numeric_limits<size_t>::max();
+    };
+}
+extern "C" {
+static void budget_hook(lua_State* L, lua_Debug*)
+{
+    auto* ctx = *static_cast<SlabContext**>(lua_getextraspace(L));
+    if (!ctx)
+        return;
+    if (ctx->abort == Abort::NONE) {
+        const auto used = ctx->budget->instructions.fetch_add(BUDGET_CHECK_INTERVAL, std::memory_order_relaxed)
+            + BUDGET_CHECK_INTERVAL;
+        if (ctx->stop.stop_requested()) {
+            ctx->abort = Abort::CANCELLED;
+        } else if (ctx->budget->instruction_limit && used > ctx->budget->instruction_limit) {
+            ctx->abort = Abort::INSTRUCTIONS;
+        } else if (ctx->budget->deadline && std::chrono::steady_clock::now() > *ctx->budget->deadline) {
+            ctx->abort = Abort::TIME;
+        }
+        // the abort is sticky: a script catching the error with pcall gets it again on its
+        // very next instruction, so it can only unwind
+        if (ctx->abort != Abort::NONE)
+            lua_sethook(L, budget_hook, LUA_MASKCOUNT, 1);
+    }
+    if (ctx->abort != Abort::NONE)
+        luaL_error(L, "evaluation aborted");
+}
+}
+namespace {
+    std::string budget_message(const VoxelEvaluator::Job& job, Abort abort, std::string_view where)
+    {
+        if (abort == Abort::INSTRUCTIONS)
+            return std::format("budget exceeded {}: the script ran more than {} instructions",
+                where, job.instruction_budget);
+        return std::format("budget exceeded {}: the script ran for more than {} ms",
+            where, job.time_budget.count());
+    }
+    /// evaluates voxels with x in [x_begin, x_end), stops on the first error or as soon as
+    /// another slab reports an error for a voxel that comes before the current one
+    void evaluate_slab(LuaSandbox& sandbox, const VoxelEvaluator::Job& job, CubeData& out,
+        int x_begin, int x_end, Budget& budget, std::atomic<size_t>& first_error, SlabResult& result)
+    {
+        // globals left behind by the previous evaluation must not leak into this one
+        sandbox.reset();
+        sandbox.reset_alloc_stats();
+        lua_State* L = sandbox.get_state();
+        switch (job.gc_mode) {
+        case LuaGcMode::Incremental:
+            lua_gc(L, LUA_GCINC, 0, 0, 0);
+            break;
+        case LuaGcMode::Generational:
+            lua_gc(L, LUA_GCGEN, 0, 0);
+            break;
+        case LuaGcMode::Paused:
+            lua_gc(L, LUA_GCSTOP);
+            break;
+        }
+        DEFER({
+            if (job.gc_mode == LuaGcMode::Paused) {
+                lua_gc(L, LUA_GCRESTART);
+                lua_gc(L, LUA_GCCOLLECT);
+            }
+        });
+        const auto fail = [&](size_t idx) {
+            const auto* msg = lua_tostring(L, -1);
+            result.error = msg ? msg : "unknown error";
+            result.error_index = idx;
+            lua_settop(L, 0);
+            auto current = first_error.load();
+            while (idx < current && !first_error.compare_exchange_weak(current, idx)) { }
+        };
+        SlabContext ctx { .budget = &budget, .stop = job.stop };
+        *static_cast<SlabContext**>(lua_getextraspace(L)) = &ctx;
+        lua_sethook(L, budget_hook, LUA_MASKCOUNT, BUDGET_CHECK_INTERVAL);
+        DEFER({
+            lua_sethook(L, NULL, 0, 0);
+            *static_cast<SlabContext**>(lua_getextraspace(L)) = nullptr;
+        });
+        const size_t slab_start = static_cast<size_t>(x_begin) * out.y * out.z;
+        if (sandbox.load(job.source, job.chunk_name)) {
+            fail(slab_start);
+            return;
+        }
+        const auto budget_error = [&](std::string_view where) {
+            if (ctx.abort != Abort::NONE) {
+                lua_settop(L, 0);
+                lua_pushstring(L, budget_message(job, ctx.abort, where).data());
+            }
+        };
+        // the chunk only builds the voxel function so it is run once, a script that caught
+        // the abort error can still return normally so the abort is checked either way
+        if (lua_pcall(L, 0, 1, 0) || ctx.abort != Abort::NONE) {
+            if (ctx.abort == Abort::CANCELLED)
+                return;
+            budget_error("before the first voxel");
+            fail(slab_start);
+            return;
+        }
+        // a copy of the voxel function stays at the bottom of the stack, a failing voxel
+        // takes the value of its Color upvalue when errors do not stop the evaluation
+        lua_pushvalue(L, -1);
+        lua::PreparedCall<int64_t(int, int, int, int, int, int)> voxel_fn;
+        try {
+            voxel_fn = lua::PreparedCall<int64_t(int, int, int, int, int, int)>(L);
+        } catch (const std::runtime_error& err) {
+            lua_pushstring(L, err.what());
+            fail(slab_start);
+            return;
+        }
+        int color_upvalue = 0;
+        for (int i = 1; job.voxel_error && !color_upvalue; i++) {
+            const char* name = lua_getupvalue(L, 1, i);
+            if (!name)
+                break;
+            lua_pop(L, 1);
+            if (std::string_view(name) == "Color")
+                color_upvalue = i;
+        }
+        size_t idx = slab_start;
+        for (int x = x_begin; x < x_end; x++) {
+            for (int y = 0; y < out.y; y++) {
+                if (job.stop.stop_requested())
+                    return;
+                for (int z = 0; z < out.z; z++, idx++) {
+                    if (idx > first_error.load(std::memory_order_relaxed))
+                        return;
+                    std::optional<int64_t> c;
+                    try {
+                        c = voxel_fn(x, y, z, out.x, out.y, out.z);
+                    } catch (const std::runtime_error& err) {
+                        if (ctx.abort == Abort::CANCELLED)
+                            return;
+                        if (ctx.abort != Abort::NONE || !job.voxel_error) {
+                            lua_pushstring(L, err.what());
+                            budget_error(std::format("at voxel ({},{},{})", x, y, z));
+                            fail(idx);
+                            return;
+                        }
+                        job.voxel_error(err.what());
+                        if (color_upvalue) {
+                            lua_getupvalue(L, 1, color_upvalue);
+                            c = lua_tointeger(L, -1);
+                            lua_pop(L, 1);
+                        }
+                    }
+                    if (ctx.abort != Abort::NONE) {
+                        if (ctx.abort == Abort::CANCELLED)
+                            return;
+                        budget_error(std::format("at voxel ({},{},{})", x, y, z));
+                        fail(idx);
+                        return;
+                    }
+                    out.set(x, y, z, decode_color_from_hex(static_cast<unsigned int>(c.value_or(0))));
+                }
+                if (job.progress)
+                    job.progress->fetch_add(out.z, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+VoxelEvaluator::VoxelEvaluator(size_t worker_count)
+    : m_worker_count(worker_count ? worker_count : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+size_t VoxelEvaluator::get_worker_count(void) const
+{
+    return m_worker_count;
+}
+void VoxelEvaluator::worker_loop(std::stop_token stop, size_t slab, uint64_t generation)
+{
+    std::unique_lock lock(m_mutex);
+    while (m_work_ready.wait(lock, stop, [&] { return m_generation != generation; })) {
+        generation = m_generation;
+        // evaluations of a cube thinner than the worker count leave some workers idle
+        if (slab >= m_slab_count)
+            continue;
+        lock.unlock();
+        m_slab_task(slab);
+        lock.lock();
+        if (--m_pending == 0)
+            m_work_done.notify_one();
+    }
+}
+LuaAllocStats VoxelEvaluator::get_alloc_stats(void) const
+{
+    LuaAllocStats stats {};
+    for (const auto& sandbox : m_sandboxes) {
+        stats += sandbox->get_alloc_stats();
+    }
+    return stats;
+}
+std::optional<std::string> VoxelEvaluator::evaluate(const Job& job, CubeData& out)
+{
+    if (out.x <= 0 || out.y <= 0 || out.z <= 0)
+        return std::nullopt;
+    const size_t slabs = std::min(m_worker_count, static_cast<size_t>(out.x));
+    while (m_sandboxes.size() < slabs) {
+        m_sandboxes.push_back(std::make_unique<LuaSandbox>());
+    }
+    std::vector<SlabResult> results(slabs);
+    std::atomic<size_t> first_error = std::numeric_limits<size_t>::max();
+    Budget budget { .instruction_limit = job.instruction_budget };
+    if (job.time_budget.count() > 0)
+        budget.deadline = std::chrono::steady_clock::now() + job.time_budget;
+    const auto slab_begin = [&](size_t i) {
+        return static_cast<int>(out.x * i / slabs);
+    };
+    while (m_workers.size() + 1 < slabs) {
+        m_workers.emplace_back([this, slab = m_workers.size() + 1, generation = m_generation](std::stop_token stop) {
+            worker_loop(stop, slab, generation);
+        });
+    }
+    {
+        // the workers point into this frame so it is only left once all of them are done
+        DEFER({
+            std::unique_lock lock(m_mutex);
+            m_work_done.wait(lock, [&] { return m_pending == 0; });
+            m_slab_task = nullptr;
+        });
+        {
+            std::lock_guard lock(m_mutex);
+            m_slab_task = [&](size_t i) {
+                evaluate_slab(*m_sandboxes[i], job, out, slab_begin(i), slab_begin(i + 1), budget,
+                    first_error, results[i]);
+            };
+            m_slab_count = slabs;
+            m_pending = slabs - 1;
+            m_generation++;
+        }
+        m_work_ready.notify_all();
+        // the calling thread takes the first slab
+        m_slab_task(0);
+    }
+    const auto first = std::ranges::min_element(results, {}, &SlabResult::error_index);
+    return first->error;
+}
+} // namespace boot
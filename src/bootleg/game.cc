@@ -1,10 +1,10 @@
 #include "meu3.h"
 #include <bootleg/game.hpp>
 #include <bootleg/lua_generics.hpp>
-#include <cstdint>
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <format>
-#include <limits>
 #include <optional>
 #include <raylib.h>
 #include <stdexcept>
@@ -21,12 +21,13 @@ extern "C" {
 constexpr const float WINDOW_BAR_HEIGHT = 1. / 30.;
 constexpr const float WINDOW_NAME_FONT_SPACING = 10;
 constexpr const int CUBE_DIMS = 10;
+/// how long a busy frame that had nothing to draw waits before polling the input again
+constexpr const double BUSY_POLL_INTERVAL = 1. / 60.;
 
 void boot::Game::init()
 {
     font = GetFontDefault();
     cube = { CUBE_DIMS, CUBE_DIMS, CUBE_DIMS };
-    init_lua_state();
     MEU3_Error err = NoError;
     meu3_pack = meu3_load_package(path::GAME_DATA_PATH.data(), &err);
     if (err != NoError) {
@@ -107,75 +108,16 @@ void boot::Game::init()
         }
     }
 }
-static void setup_colors(lua_State* lua)
+void boot::Game::reset_lua_state(void)
 {
-    const auto add_color = [=](const std::string_view name, const Color& col) {
-        static unsigned char hex[4] = {};
-        hex[3] = col.r;
-        hex[2] = col.g;
-        hex[1] = col.b;
-        hex[0] = col.a;
-        boot::lua::setglobalv(lua, name.data(),
-            *reinterpret_cast<unsigned int*>(&hex));
-    };
-    for (const auto& [k, v] : boot::colors::COLORMAP) {
-        add_color(k, v);
-    }
-}
-extern "C" {
-static int l_color__from_parts(lua_State* L)
-{
-    int n = lua_gettop(L);
-    if (n != 3)
-        return 0;
-    const bool all_nums = lua_isnumber(L, 1) && lua_isnumber(L, 2) && lua_isnumber(L, 3);
-    if (!all_nums)
-        return 0;
-    constexpr const auto max = std::numeric_limits<decltype(Color::a)>::max();
-    Color color = {};
-    color.a = max;
-    color.r = std::abs(lua_tonumber(L, 1)) * max;
-    color.g = std::abs(lua_tonumber(L, 2)) * max;
-    color.b = std::abs(lua_tonumber(L, 3)) * max;
-    int32_t raw_color = 0;
-    int8_t* bytes = reinterpret_cast<int8_t*>(&raw_color);
-    bytes[3] = color.r;
-    bytes[2] = color.g;
-    bytes[1] = color.b;
-    bytes[0] = color.a;
-    lua_pushinteger(L, raw_color);
-    return 1;
-}
-}
-void boot::Game::init_lua_state(void)
-{
-    if (m_lua_state) {
-        lua_close(m_lua_state);
-        m_lua_state = NULL;
-    }
-    m_lua_state = luaL_newstate();
-    luaL_openlibs(m_lua_state);
-    lua::setglobalv(m_lua_state, "io", LUA_TNIL);
-    lua::setglobalv(m_lua_state, "table", LUA_TNIL);
-    lua::setglobalv(m_lua_state, "string", LUA_TNIL);
-    lua::setglobalv(m_lua_state, "os", LUA_TNIL);
-    lua::setglobalv(m_lua_state, "debug", LUA_TNIL);
-    lua::setglobalv(m_lua_state, "print", LUA_TNIL);
-
-    lua_createtable(m_lua_state, 0, 1);
-    lua_pushstring(m_lua_state, "fromRGB");
-    lua_pushcfunction(m_lua_state, l_color__from_parts);
-    lua_settable(m_lua_state, 1);
-    lua_setglobal(m_lua_state, "color");
-    lua::setglobalv(m_lua_state, "x", 0);
-    lua::setglobalv(m_lua_state, "y", 0);
-    lua::setglobalv(m_lua_state, "z", 0);
-    lua::setglobalv(m_lua_state, "Color", 0);
-    setup_colors(m_lua_state);
-    lua_settop(m_lua_state, 0);
+    const auto start_time = GetTime();
+    const auto cleared = m_sandbox.reset();
+    TraceLog(LOG_DEBUG, "Reset the lua sandbox in %.3f us (%zu globals cleared)",
+        (GetTime() - start_time) * 1000000., cleared);
 }
 void boot::Game::deinit()
 {
+    cancel_evaluation();
     windows.clear();
     meu3_free_package(meu3_pack);
     meu3_pack = nullptr;
@@ -200,9 +142,27 @@ void boot::Game::update_measurements(void)
         });
     }
 }
+static bool had_input(void)
+{
+    const auto delta = GetMouseDelta();
+    const auto wheel = GetMouseWheelMoveV();
+    if (delta.x != 0 || delta.y != 0 || wheel.x != 0 || wheel.y != 0)
+        return true;
+    for (int button = MOUSE_BUTTON_LEFT; button <= MOUSE_BUTTON_BACK; button++) {
+        if (IsMouseButtonPressed(button) || IsMouseButtonReleased(button))
+            return true;
+    }
+    for (int key = KEY_SPACE; key <= KEY_KB_MENU; key++) {
+        if (IsKeyPressed(key) || IsKeyPressedRepeat(key) || IsKeyReleased(key))
+            return true;
+    }
+    return false;
+}
 void boot::Game::update()
 {
     bool resized = IsWindowResized();
+    if (resized || had_input())
+        m_redraw = true;
     if (resized) {
         m_dims = { (float)GetScreenWidth(), (float)GetScreenHeight() };
         update_measurements();
@@ -219,10 +179,32 @@ void boot::Game::update()
             }
         }
     }
+    poll_evaluation();
+    // the window may have changed while the evaluation runs
+    update_exit_key();
     windows[m_current_window].win->update(*this);
 }
+void boot::Game::update_event_waiting(void)
+{
+    if (is_evaluating() || windows[m_current_window].win->is_redraw_requested())
+        DisableEventWaiting();
+    else
+        EnableEventWaiting();
+}
 void boot::Game::draw()
 {
+    if (windows[m_current_window].win->take_redraw_request())
+        m_redraw = true;
+    if (!m_redraw) {
+        // nothing changed since the last frame so only the input gets polled, EndDrawing
+        // would do that otherwise
+        update_event_waiting();
+        if (is_evaluating())
+            WaitTime(BUSY_POLL_INTERVAL);
+        PollInputEvents();
+        return;
+    }
+    m_redraw = false;
     BeginDrawing();
     ClearBackground(BLACK);
     windows[m_current_window].win->draw(*this);
@@ -250,6 +232,8 @@ void boot::Game::draw()
                 WINDOW_NAME_FONT_SPACING, WHITE);
         }
     }
+    // EndDrawing polls the input, it has to know whether to wait for it
+    update_event_waiting();
     EndDrawing();
 }
 Color boot::decode_color_from_hex(unsigned int hex_color)
@@ -264,95 +248,176 @@ Color boot::decode_color_from_hex(unsigned int hex_color)
     ret.r |= hex_color;
     return ret;
 }
-std::optional<std::string> boot::Game::load_source(const std::string& source)
+void boot::Game::load_source(std::string source)
 {
-    level_completed = m_solution.has_value();
-    for (int x = 0; x < cube.x; x++) {
-        for (int y = 0; y < cube.y; y++) {
-            for (int z = 0; z < cube.z; z++) {
-                lua::setglobalv(m_lua_state, "X", cube.x);
-                lua::setglobalv(m_lua_state, "Y", cube.y);
-                lua::setglobalv(m_lua_state, "Z", cube.z);
-
-                lua::setglobalv(m_lua_state, "Color", 0);
-                lua::setglobalv(m_lua_state, "x", x);
-                lua::setglobalv(m_lua_state, "y", y);
-                lua::setglobalv(m_lua_state, "z", z);
-                if (luaL_dostring(m_lua_state, source.data())) {
-                    auto* err = lua_tostring(m_lua_state, -1);
-                    std::printf("pcall failed : %s\n", err);
-                    level_completed = false;
-                    return err;
-                }
-                auto c = lua::getglobalv<unsigned int>(m_lua_state, "Color");
-                cube.color_data[x][y][z] = boot::decode_color_from_hex(c.value_or(0));
-                const auto color_eq = [](const Color& a, const Color& b) -> bool {
-                    return a.r == b.r && a.b == b.b && a.g == b.g && a.a == b.a;
-                };
-                if (m_solution.has_value())
-                    level_completed &= color_eq(cube.color_data[x][y][z],
-                        m_solution->solution->color_data[x][y][z]);
-            }
+    cancel_evaluation();
+    // a successful run writes every voxel, the copy only brings the back buffer to the size
+    // and bricks of the current cube
+    m_back_cube.copy_from(cube);
+    m_eval_progress = 0;
+    m_eval_done = false;
+    // the configuration can be reloaded while the job runs, so it only gets read here
+    const auto instruction_budget = static_cast<uint64_t>(std::max(0ll, m_conf.eval_budget_instructions));
+    const auto time_budget = std::chrono::milliseconds(std::max(0, m_conf.eval_budget_ms));
+    const auto gc_mode = m_conf.eval_gc_mode;
+    m_eval_thread = std::jthread([this, source = std::move(source), instruction_budget, time_budget,
+                                     gc_mode](std::stop_token stop) mutable {
+        const auto start_time = GetTime();
+        // the chunk name matches the one luaL_dostring would give it so that error messages
+        // stay the same
+        const auto wrapped = wrap_player_source(source);
+        const auto job = VoxelEvaluator::Job {
+            .source = wrapped,
+            .chunk_name = source.data(),
+            .progress = &m_eval_progress,
+            .stop = stop,
+            .instruction_budget = instruction_budget,
+            .time_budget = time_budget,
+            .gc_mode = gc_mode,
+        };
+        auto err = m_evaluator.evaluate(job, m_back_cube);
+        TraceLog(LOG_DEBUG, "Evaluated %d voxels in %.3f ms on %zu threads",
+            m_back_cube.x * m_back_cube.y * m_back_cube.z,
+            (GetTime() - start_time) * 1000., m_evaluator.get_worker_count());
+        const auto alloc_stats = m_evaluator.get_alloc_stats();
+        TraceLog(LOG_DEBUG, "Lua allocations: %llu (%llu from the pool), reallocations: %llu, "
+                            "frees: %llu, peak: %zu KiB, pool: %zu KiB",
+            (unsigned long long)alloc_stats.allocations, (unsigned long long)alloc_stats.pool_hits,
+            (unsigned long long)alloc_stats.reallocations, (unsigned long long)alloc_stats.frees,
+            alloc_stats.peak_bytes / 1024, alloc_stats.pool_bytes / 1024);
+        m_eval_census = std::nullopt;
+        if (err) {
+            std::printf("pcall failed : %s\n", err->data());
+        } else {
+            // bricks that were copied over but got blanked by this run are dropped
+            m_back_cube.compact();
+            if (m_solution)
+                m_eval_census = take_census(m_back_cube, *m_solution->solution);
         }
+        m_eval_result = EvaluationResult { .error = std::move(err), .source = std::move(source) };
+        m_eval_done.store(true, std::memory_order_release);
+    });
+    update_exit_key();
+}
+void boot::Game::cancel_evaluation(void)
+{
+    if (m_eval_thread.joinable()) {
+        m_eval_thread.request_stop();
+        m_eval_thread.join();
     }
-    return std::nullopt;
+    m_eval_done = false;
+    update_exit_key();
+}
+void boot::Game::update_exit_key(void)
+{
+    // escape cancels the evaluation in the editor, everywhere else it closes the game as usual
+    const auto in_editor = !windows.empty()
+        && std::string_view(windows[m_current_window].win->get_window_name()) == "editor";
+    SetExitKey(is_evaluating() && in_editor ? KEY_NULL : KEY_ESCAPE);
+}
+bool boot::Game::is_evaluating(void) const
+{
+    return m_eval_thread.joinable();
+}
+float boot::Game::get_evaluation_progress(void) const
+{
+    const auto total = m_back_cube.x * m_back_cube.y * m_back_cube.z;
+    if (!is_evaluating() || total <= 0)
+        return 0;
+    return m_eval_progress.load(std::memory_order_relaxed) / static_cast<float>(total);
+}
+void boot::Game::poll_evaluation(void)
+{
+    if (!m_eval_thread.joinable() || !m_eval_done.load(std::memory_order_acquire))
+        return;
+    m_eval_thread.join();
+    m_eval_done = false;
+    update_exit_key();
+    if (m_eval_result.error) {
+        // which voxels after the failing one got written depends on the thread timing, so a
+        // failed run is thrown away and the cube stays as it was
+        level_completed = false;
+    } else {
+        // the back buffer only gets swapped in on the main thread so drawing never sees a
+        // half evaluated cube
+        std::swap(cube, m_back_cube);
+        m_census = std::move(m_eval_census);
+        m_cube_version++;
+        level_completed = m_census && m_census->completed;
+    }
+    if (level_completed)
+        m_eval_result.solution_saved = save_solution_for_current_level(std::string(m_eval_result.source));
+    m_last_eval_result = std::move(m_eval_result);
+    m_eval_result = {};
+    m_eval_count++;
+    m_redraw = true;
+}
+const std::optional<boot::Game::EvaluationResult>& boot::Game::get_evaluation_result(void) const
+{
+    return m_last_eval_result;
+}
+uint64_t boot::Game::get_evaluation_count(void) const
+{
+    return m_eval_count;
 }
 Color boot::Game::color_for(int x, int y, int z)
 {
-    return this->cube.color_data[x][y][z];
+    return this->cube.get(x, y, z);
 }
 namespace boot {
 void Game::preload_lua_level(Level& lvl)
 {
     if (lvl.ty != Level::Type::Lua)
         return;
-    init_lua_state();
+    reset_lua_state();
     auto data = raw::LevelData {};
-    auto error = luaL_loadbuffer(m_lua_state, reinterpret_cast<const char*>(lvl.data_ptr),
-        lvl.data_len, NULL);
+    auto error = m_sandbox.load(
+        std::string_view(reinterpret_cast<const char*>(lvl.data_ptr), lvl.data_len), NULL);
     if (error != LUA_OK) {
         TraceLog(LOG_ERROR, "Error while preloading lua levelgen script\n%s",
-            lua_tostring(m_lua_state, -1));
+            lua_tostring(m_sandbox.get_state(), -1));
         goto crash_and_burn;
     }
     try {
-        lua::voidpcall(m_lua_state, NULL);
+        lua::voidpcall(m_sandbox.get_state(), NULL);
     } catch (const std::runtime_error& err) {
         TraceLog(LOG_ERROR,
             "Error while running lua levelgen script for preload\n%s",
             err.what());
         goto crash_and_burn;
     }
-    data.X = lua::getglobalv<int>(m_lua_state, "X").value_or(-1);
-    data.Y = lua::getglobalv<int>(m_lua_state, "Y").value_or(-1);
-    data.Z = lua::getglobalv<int>(m_lua_state, "Z").value_or(-1);
-    data.name = lua::getglobalv<std::string>(m_lua_state, "Name").value_or("");
-    data.desc = lua::getglobalv<std::string>(m_lua_state, "Desc").value_or("");
+    data.X = m_sandbox.get<int>("X").value_or(-1);
+    data.Y = m_sandbox.get<int>("Y").value_or(-1);
+    data.Z = m_sandbox.get<int>("Z").value_or(-1);
+    data.name = m_sandbox.get<std::string>("Name").value_or("");
+    data.desc = m_sandbox.get<std::string>("Desc").value_or("");
     lvl.data = data;
 crash_and_burn:
-    lua_settop(m_lua_state, 0);
-    init_lua_state();
+    reset_lua_state();
 }
 void Game::load_level(const Level& lvl, std::string name)
 {
+    cancel_evaluation();
+    m_last_eval_result = std::nullopt;
     m_solution = std::nullopt;
+    m_census = std::nullopt;
+    m_cube_version++;
     saved_solution = std::nullopt;
     std::string lvl_name, lvl_desc;
     CubeData *sol {}, *sol_cube {};
     MEU3_Error err = NoError;
     const auto saved_path = std::format("{}/{}", path::USER_SOLUTIONS_DIR, name);
     if (lvl.ty == Level::Type::Lua) {
-        init_lua_state();
-        auto error = luaL_loadbuffer(m_lua_state,
-            reinterpret_cast<const char*>(lvl.data_ptr),
-            lvl.data_len, NULL);
+        reset_lua_state();
+        auto error = m_sandbox.load(
+            std::string_view(reinterpret_cast<const char*>(lvl.data_ptr), lvl.data_len), NULL);
         if (error != LUA_OK) {
             TraceLog(LOG_ERROR, "Error while loading lua levelgen script\n%s",
-                lua_tostring(m_lua_state, -1));
+                lua_tostring(m_sandbox.get_state(), -1));
             goto crash_and_burn;
         }
         try {
-            lua::voidpcall(m_lua_state, NULL);
+            lua::voidpcall(m_sandbox.get_state(), NULL);
         } catch (const std::runtime_error& err) {
             TraceLog(LOG_ERROR, "Error while running lua levelgen script\n%s",
                 err.what());
@@ -360,7 +425,7 @@ void Game::load_level(const Level& lvl, std::string name)
         }
         int x {}, y {}, z {};
         const auto get_dim = [&](const char* name, int& out) -> bool {
-            auto v = lua::getglobalv<int>(m_lua_state, name);
+            auto v = m_sandbox.get<int>(name);
             if (!v) {
                 TraceLog(LOG_ERROR,
                     "Error while running lua levelgen script: variable '%s' was "
@@ -377,8 +442,8 @@ void Game::load_level(const Level& lvl, std::string name)
             goto crash_and_burn;
         if (!get_dim("Z", z))
             goto crash_and_burn;
-        lvl_name = lua::getglobalv<std::string>(m_lua_state, "Name").value_or("");
-        lvl_desc = lua::getglobalv<std::string>(m_lua_state, "Desc").value_or("");
+        lvl_name = m_sandbox.get<std::string>("Name").value_or("");
+        lvl_desc = m_sandbox.get<std::string>("Desc").value_or("");
 
         m_solution = raw::LevelData {
             .X = x,
@@ -390,27 +455,19 @@ void Game::load_level(const Level& lvl, std::string name)
         };
 
         sol = &m_solution->solution.value();
-        for (int x = 0; x < sol->x; x++) {
-            for (int y = 0; y < sol->y; y++) {
-                for (int z = 0; z < sol->z; z++) {
-                    lua::setglobalv(m_lua_state, "X", sol->x);
-                    lua::setglobalv(m_lua_state, "Y", sol->y);
-                    lua::setglobalv(m_lua_state, "Z", sol->z);
-
-                    lua::setglobalv(m_lua_state, "Color", 0);
-                    lua::setglobalv(m_lua_state, "x", x);
-                    lua::setglobalv(m_lua_state, "y", y);
-                    lua::setglobalv(m_lua_state, "z", z);
-                    try {
-                        lua::voidpcall(m_lua_state, "Generate");
-                    } catch (const std::runtime_error& err) {
-                        TraceLog(LOG_ERROR, "Error while running lua levelgen script\n%s",
-                            err.what());
-                    }
-                    auto c = lua::getglobalv<unsigned int>(m_lua_state, "Color");
-                    sol->color_data[x][y][z] = decode_color_from_hex(c.value_or(0));
-                }
-            }
+        const auto wrapped = wrap_level_source(
+            std::string_view(reinterpret_cast<const char*>(lvl.data_ptr), lvl.data_len));
+        // like the per-voxel pcalls used to, a failing voxel is logged and generation goes on
+        const auto job = VoxelEvaluator::Job {
+            .source = wrapped,
+            .chunk_name = NULL,
+            .voxel_error = [](std::string_view error) {
+                TraceLog(LOG_ERROR, "Error while running lua levelgen script\n%s", error.data());
+            },
+        };
+        if (auto err = m_evaluator.evaluate(job, *sol); err) {
+            TraceLog(LOG_ERROR, "Error while running lua levelgen script\n%s",
+                err->data());
         }
 
     } else {
@@ -420,6 +477,8 @@ void Game::load_level(const Level& lvl, std::string name)
     }
     sol_cube = &m_solution->solution.value();
     cube = CubeData(sol_cube->x, sol_cube->y, sol_cube->z);
+    m_census = take_census(cube, *sol_cube);
+    m_cube_version++;
     m_current_save_name = name;
     if (meu3_package_has(meu3_pack, saved_path.data(), &err)) {
         auto len = 0ull;
@@ -436,8 +495,7 @@ void Game::load_level(const Level& lvl, std::string name)
     return;
 crash_and_burn:
     m_solution = std::nullopt;
-    lua_settop(m_lua_state, 0);
-    init_lua_state();
+    reset_lua_state();
     return;
 }
 void Game::transition_to(std::string_view window_name)
@@ -445,6 +503,7 @@ void Game::transition_to(std::string_view window_name)
     for (size_t i = 0; i < windows.size(); i++) {
         if (window_name == windows[i].win->get_window_name()) {
             m_current_window = i;
+            m_redraw = true;
             windows[i].win->on_transition(*this);
             return;
         }
@@ -501,31 +560,48 @@ void Game::save_game_data(void)
 void Game::reload_configuration(std::string&& config_source)
 {
     Config& conf = m_conf;
-    init_lua_state();
-    luaL_dostring(m_lua_state, config_source.data());
-    if (auto c = lua::getglobalv<unsigned int>(m_lua_state, "ForeColor"); c) {
+    reset_lua_state();
+    m_sandbox.run(config_source, config_source.data());
+    if (auto c = m_sandbox.get<unsigned int>("ForeColor"); c) {
         conf.foreground_color = decode_color_from_hex(*c);
     }
-    if (auto c = lua::getglobalv<std::string>(m_lua_state, "ForeColor");
+    if (auto c = m_sandbox.get<std::string>("ForeColor");
         c && boot::colors::COLORMAP.contains(*c)) {
         conf.foreground_color = boot::colors::COLORMAP.at(*c);
     }
-    if (auto c = lua::getglobalv<unsigned int>(m_lua_state, "BackColor"); c) {
+    if (auto c = m_sandbox.get<unsigned int>("BackColor"); c) {
         conf.background_color = decode_color_from_hex(*c);
     }
-    if (auto c = lua::getglobalv<std::string>(m_lua_state, "BackColor");
+    if (auto c = m_sandbox.get<std::string>("BackColor");
         c && boot::colors::COLORMAP.contains(*c)) {
         conf.background_color = boot::colors::COLORMAP.at(*c);
     }
-    if (auto b = lua::getglobalv<bool>(m_lua_state, "WrapLines"); b) {
+    if (auto b = m_sandbox.get<bool>("WrapLines"); b) {
         conf.wrap_lines = *b;
     }
-    if (auto i = lua::getglobalv<int>(m_lua_state, "FontSize"); i) {
+    if (auto i = m_sandbox.get<int>("FontSize"); i) {
         conf.font_size = *i;
     }
-    if (auto b = lua::getglobalv<bool>(m_lua_state, "Syntax"); b) {
+    if (auto b = m_sandbox.get<bool>("Syntax"); b) {
         conf.syntax_highlighting = *b;
     }
+    if (auto i = m_sandbox.get<int>("EvalBudgetMs"); i) {
+        conf.eval_budget_ms = *i;
+    }
+    if (auto i = m_sandbox.get<long long>("EvalBudgetInstructions"); i) {
+        conf.eval_budget_instructions = *i;
+    }
+    if (auto s = m_sandbox.get<std::string>("EvalGcMode"); s) {
+        if (*s == "incremental")
+            conf.eval_gc_mode = LuaGcMode::Incremental;
+        else if (*s == "generational")
+            conf.eval_gc_mode = LuaGcMode::Generational;
+        else if (*s == "paused")
+            conf.eval_gc_mode = LuaGcMode::Paused;
+    }
+    if (auto f = m_sandbox.get<float>("MovingRenderScale"); f) {
+        conf.moving_render_scale = *f;
+    }
     for (auto& [w, b] : windows) {
         w->on_config_reload(conf);
     }
@@ -534,4 +610,12 @@ const std::optional<raw::LevelData>& Game::get_lvl_data(void)
 {
     return this->m_solution;
 }
+const std::optional<CubeCensus>& Game::get_census(void) const
+{
+    return this->m_census;
+}
+uint64_t Game::get_cube_version(void) const
+{
+    return this->m_cube_version;
+}
 } // namespace boot
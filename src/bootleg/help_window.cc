@@ -42,6 +42,8 @@ The editor buffer works like a regular text buffer except it has additional spec
  - <C-g> jump to the bottom of the buffer,
 
 When you want to execute the Lua code you press <Shift-Enter>
+While the code is being evaluated you can cancel it with <Esc>
+If the evaluation takes too long it gets stopped, the limits can be changed in the configuration (`EvalBudgetMs`, `EvalBudgetInstructions`)
 When you want to save the Lua code you press <Control-s>
 
 ## Lua specials
@@ -109,7 +111,7 @@ void HelpWindow::on_config_reload(const Config& conf)
         m_help_buffer->background_color = conf.background_color;
         using namespace std::placeholders;
         m_help_buffer->set_syntax_parser(std::bind(
-            boot::markdown_like_syntax_parser, conf.foreground_color, _1, _2, _3));
+            boot::markdown_like_syntax_parser, conf.foreground_color, _1, _2, _3, _4));
         m_help_buffer->update_syntax();
     }
 }
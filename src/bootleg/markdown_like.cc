@@ -11,11 +11,13 @@ static const Color HEADER_5 = HEADER_1;
 static const Color HEADER_6 = boot::decode_color_from_hex(0xC185BCFF);
 static const Color BRACKETS = HEADER_4;
 }
-void boot::markdown_like_syntax_parser(Color foreground,
+boot::buffer_t::syntax_state_t boot::markdown_like_syntax_parser(Color foreground,
     buffer_t::syntax_data_t& syntax,
+    buffer_t::syntax_state_t,
     buffer_t::text_buffer_iterator tit,
     const buffer_t::text_buffer_iterator end)
 {
+    // nothing spans lines, every line starts and ends with no state
     buffer_t::Cursor pos = tit.current_cursor_pos();
     for (; tit != end;) {
         pos = tit.current_cursor_pos();
@@ -31,23 +33,23 @@ void boot::markdown_like_syntax_parser(Color foreground,
             ch = *tit;
             if (ch != ' ' && ch != '#')
                 break;
-            syntax[pos] = tokens::HEADER_1;
+            syntax.append(pos, tokens::HEADER_1);
             for (; tit != end; tit++) {
                 const auto ch = *tit;
                 if (ch == '#' && prev_was_hash) {
                     hash_count++;
                     if (hash_count == 2) {
-                        syntax[pos] = tokens::HEADER_2;
+                        syntax.append(pos, tokens::HEADER_2);
                     } else if (hash_count == 3) {
-                        syntax[pos] = tokens::HEADER_3;
+                        syntax.append(pos, tokens::HEADER_3);
                     } else if (hash_count == 4) {
-                        syntax[pos] = tokens::HEADER_4;
+                        syntax.append(pos, tokens::HEADER_4);
                     } else if (hash_count == 5) {
-                        syntax[pos] = tokens::HEADER_5;
+                        syntax.append(pos, tokens::HEADER_5);
                     } else if (hash_count == 6) {
-                        syntax[pos] = tokens::HEADER_6;
+                        syntax.append(pos, tokens::HEADER_6);
                     } else {
-                        syntax[pos] = foreground;
+                        syntax.append(pos, foreground);
                     }
                 } else {
                     prev_was_hash = false;
@@ -64,13 +66,13 @@ void boot::markdown_like_syntax_parser(Color foreground,
                 break;
             ch = *tit;
             if (ch != '-' && ch != '*' && ch != '+') {
-                syntax[pos] = foreground;
+                syntax.append(pos, foreground);
                 goto skip_pos_increment;
             };
-            syntax[pos] = tokens::LIST_ELEMENT;
+            syntax.append(pos, tokens::LIST_ELEMENT);
             break;
         case '\n':
-            syntax[pos] = foreground;
+            syntax.append(pos, foreground);
             break;
         case '[': {
             int closed = 0;
@@ -83,10 +85,10 @@ void boot::markdown_like_syntax_parser(Color foreground,
                 else if (ch == '\n')
                     goto skip_pos_increment;
                 if (closed == 0) {
-                    syntax[pos] = tokens::BRACKETS;
+                    syntax.append(pos, tokens::BRACKETS);
                     tit++;
                     pos = tit.current_cursor_pos();
-                    syntax[pos] = foreground;
+                    syntax.append(pos, foreground);
                     break;
                 }
             }
@@ -102,19 +104,20 @@ void boot::markdown_like_syntax_parser(Color foreground,
                 else if (ch == '\n')
                     goto skip_pos_increment;
                 if (closed == 0) {
-                    syntax[pos] = tokens::HEADER_6;
+                    syntax.append(pos, tokens::HEADER_6);
                     tit++;
                     pos = tit.current_cursor_pos();
-                    syntax[pos] = foreground;
+                    syntax.append(pos, foreground);
                     break;
                 }
             }
         } break;
         default:
-            syntax[pos] = foreground;
+            syntax.append(pos, foreground);
             break;
         }
         tit++;
     skip_pos_increment:
     }
+    return {};
 }
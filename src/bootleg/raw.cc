@@ -166,9 +166,9 @@ LevelData parse_level_data(std::string&& src, bool skip_data_section)
                     if ((size_t)pos < current_chunk->size()) {
                         c = (*current_chunk)[pos];
                     }
-                    lvl.solution->color_data[x][y][z] = c;
+                    lvl.solution->set(x, y, z, c);
                 } else {
-                    lvl.solution->color_data[x][y][z] = BLANK;
+                    lvl.solution->set(x, y, z, BLANK);
                 }
             }
         }
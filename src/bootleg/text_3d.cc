@@ -1,8 +1,64 @@
+#include <algorithm>
+#include <array>
+#include <bitset>
 #include <bootleg/game.hpp>
 #include <numbers>
 #include <raylib.h>
 #include <raymath.h>
 #include <rlgl.h>
+#include <unordered_map>
+
+namespace {
+/// atlas rectangles of the glyphs of the last used font, GetGlyphAtlasRec searches all the
+/// glyphs of the font on every call. A font is told apart by its texture and its glyph
+/// arrays, a texture id can be reused by a font loaded after the previous one was unloaded
+struct GlyphRecCache {
+    unsigned int texture_id {};
+    int glyph_count {};
+    const Rectangle* recs {};
+    const GlyphInfo* glyphs {};
+    std::array<Rectangle, 128> ascii {};
+    std::bitset<128> ascii_known {};
+    std::unordered_map<int, Rectangle> other {};
+};
+Rectangle glyph_rec(Font font, int codepoint)
+{
+    static GlyphRecCache cache {};
+    if (cache.texture_id != font.texture.id || cache.glyph_count != font.glyphCount
+        || cache.recs != font.recs || cache.glyphs != font.glyphs) {
+        cache = {};
+        cache.texture_id = font.texture.id;
+        cache.glyph_count = font.glyphCount;
+        cache.recs = font.recs;
+        cache.glyphs = font.glyphs;
+    }
+    if (codepoint >= 0 && codepoint < static_cast<int>(cache.ascii.size())) {
+        if (!cache.ascii_known[codepoint]) {
+            cache.ascii[codepoint] = GetGlyphAtlasRec(font, codepoint);
+            cache.ascii_known[codepoint] = true;
+        }
+        return cache.ascii[codepoint];
+    }
+    const auto [it, inserted] = cache.other.try_emplace(codepoint);
+    if (inserted)
+        it->second = GetGlyphAtlasRec(font, codepoint);
+    return it->second;
+}
+Vector2 glyph_size(Rectangle rec, Font font, float font_size)
+{
+    const float scale = font_size / static_cast<float>(font.baseSize);
+    return {
+        (rec.width + 2 * font.glyphPadding) * scale,
+        (rec.height + 2 * font.glyphPadding) * scale,
+    };
+}
+Matrix rotation_matrix(const boot::Rotation& rotation)
+{
+    return MatrixRotate({ rotation.x, rotation.y, rotation.z },
+        rotation.angle * (std::numbers::pi / 180.));
+}
+}
+
 namespace boot {
 Vector2 measure_codepoint_3d(int codepoint, Font font, float font_size)
 {
@@ -10,12 +66,7 @@ Vector2 measure_codepoint_3d(int codepoint, Font font, float font_size)
         TraceLog(LOG_ERROR, "draw_codepoint_3d: font texture was null");
         return Vector2Zero();
     }
-    const auto glyph_rec = GetGlyphAtlasRec(font, codepoint);
-    const float scale = font_size / static_cast<float>(font.baseSize);
-
-    const float width = (glyph_rec.width + 2 * font.glyphPadding) * scale;
-    const float height = (glyph_rec.height + 2 * font.glyphPadding) * scale;
-    return { width, height };
+    return glyph_size(glyph_rec(font, codepoint), font, font_size);
 }
 Vector2 measure_text_3d(const char* txt, Font font, float font_size,
     float spacing)
@@ -46,19 +97,9 @@ void draw_text_3d(const char* txt, Font font, Vector3 pos, float font_size,
         TraceLog(LOG_ERROR, "draw_text_3d: font texture was null");
         return;
     }
-    const auto dir = Vector3Normalize(
-        Vector3RotateByAxisAngle({ 1, 0, 0 }, { rotation.x, rotation.y, rotation.z },
-            rotation.angle * (std::numbers::pi / 180.)));
-    const auto view = std::string_view(txt);
-    for (size_t c = 0; c < view.size();) {
-        int csz = 1;
-        const int codepoint = GetCodepoint(view.data() + c, &csz);
-        const auto sz = draw_codepoint_3d(codepoint, font, pos, font_size, color,
-            backface, rotation);
-        c += csz;
-        const auto tmp = Vector3Scale(dir, sz.x + spacing);
-        pos = Vector3Add(pos, tmp);
-    }
+    TextBatch3D batch { font };
+    batch.add_text(txt, pos, font_size, spacing, color, backface, rotation);
+    batch.flush();
 }
 Vector2 draw_codepoint_3d(int codepoint, Font font, const Vector3& pos,
     float font_size, const Color& color, bool backface,
@@ -68,57 +109,178 @@ Vector2 draw_codepoint_3d(int codepoint, Font font, const Vector3& pos,
         TraceLog(LOG_ERROR, "draw_codepoint_3d: font texture was null");
         return Vector2Zero();
     }
-    const auto glyph_rec = GetGlyphAtlasRec(font, codepoint);
-    const float scale = font_size / static_cast<float>(font.baseSize);
-
-    const float width = (glyph_rec.width + 2 * font.glyphPadding) * scale;
-    const float height = (glyph_rec.height + 2 * font.glyphPadding) * scale;
-
-    const float x = 0.0f;
-    const float y = 0.0f;
-    const float z = 0.0f;
-
-    const float tx = glyph_rec.x / font.texture.width;
-    const float ty = glyph_rec.y / font.texture.height;
-    const float tw = (glyph_rec.x + glyph_rec.width) / font.texture.width;
-    const float th = (glyph_rec.y + glyph_rec.height) / font.texture.height;
+    TextBatch3D batch { font };
+    const auto sz = batch.add_codepoint(codepoint, pos, font_size, color, backface, rotation);
+    batch.flush();
+    return sz;
+}
 
-    rlSetTexture(font.texture.id);
-    rlPushMatrix();
-    {
-        rlTranslatef(pos.x, pos.y, pos.z);
-        rlRotatef(rotation.angle, rotation.x, rotation.y, rotation.z);
-        rlBegin(RL_QUADS);
-        {
-            rlColor4ub(color.r, color.g, color.b, color.a);
-            const auto dir = Vector3Normalize(Vector3RotateByAxisAngle(
-                { 0, 0, 1 }, { rotation.x, rotation.y, rotation.z },
-                rotation.angle * (std::numbers::pi / 180.)));
-            rlNormal3f(dir.x, dir.y, dir.z);
-            rlTexCoord2f(tx, ty);
-            rlVertex3f(x, y, z);
-            rlTexCoord2f(tx, th);
-            rlVertex3f(x, y - height, z);
-            rlTexCoord2f(tw, th);
-            rlVertex3f(x + width, y - height, z);
-            rlTexCoord2f(tw, ty);
-            rlVertex3f(x + width, y, z);
-            if (backface) {
-                rlNormal3f(0.0f, 0.0f, -1.0f);
-                rlTexCoord2f(tx, ty);
-                rlVertex3f(x, y, z);
-                rlTexCoord2f(tw, ty);
-                rlVertex3f(x + width, y, z);
-                rlTexCoord2f(tw, th);
-                rlVertex3f(x + width, y - height, z);
-                rlTexCoord2f(tx, th);
-                rlVertex3f(x, y - height, z);
-            }
+TextBatch3D::TextBatch3D(Font font)
+    : m_font(font)
+{
+}
+void TextBatch3D::set_font(Font font)
+{
+    m_font = font;
+    m_quads.clear();
+}
+Font TextBatch3D::get_font(void) const
+{
+    return m_font;
+}
+Vector2 TextBatch3D::add_codepoint(int codepoint, Vector3 pos, float font_size,
+    const Color& color, bool backface, const Rotation& rotation)
+{
+    return add_codepoint(codepoint, pos, font_size, color, backface, rotation_matrix(rotation));
+}
+Vector2 TextBatch3D::add_codepoint(int codepoint, Vector3 pos, float font_size,
+    const Color& color, bool backface, const Matrix& rotation)
+{
+    if (m_font.texture.id <= 0) {
+        TraceLog(LOG_ERROR, "TextBatch3D: font texture was null");
+        return Vector2Zero();
+    }
+    const auto rec = glyph_rec(m_font, codepoint);
+    const auto size = glyph_size(rec, m_font, font_size);
+    const float tx = rec.x / m_font.texture.width;
+    const float ty = rec.y / m_font.texture.height;
+    const float tw = (rec.x + rec.width) / m_font.texture.width;
+    const float th = (rec.y + rec.height) / m_font.texture.height;
+    const Vector3 local[4] = { { 0, 0, 0 }, { 0, -size.y, 0 }, { size.x, -size.y, 0 }, { size.x, 0, 0 } };
+    Quad quad = {
+        .corners = {},
+        .texcoords = { { tx, ty }, { tx, th }, { tw, th }, { tw, ty } },
+        .color = color,
+    };
+    for (int i = 0; i < 4; i++)
+        quad.corners[i] = Vector3Add(pos, Vector3Transform(local[i], rotation));
+    m_quads.push_back(quad);
+    if (backface) {
+        // the same quad wound the other way around
+        std::swap(quad.corners[1], quad.corners[3]);
+        std::swap(quad.texcoords[1], quad.texcoords[3]);
+        m_quads.push_back(quad);
+    }
+    return size;
+}
+void TextBatch3D::add_text(const char* txt, Vector3 pos, float font_size, float spacing,
+    const Color& color, bool backface, const Rotation& rotation)
+{
+    const auto rot = rotation_matrix(rotation);
+    const auto dir = Vector3Normalize(Vector3Transform({ 1, 0, 0 }, rot));
+    const auto view = std::string_view(txt);
+    for (size_t c = 0; c < view.size();) {
+        int csz = 1;
+        const int codepoint = GetCodepoint(view.data() + c, &csz);
+        const auto sz = add_codepoint(codepoint, pos, font_size, color, backface, rot);
+        c += csz;
+        pos = Vector3Add(pos, Vector3Scale(dir, sz.x + spacing));
+    }
+}
+const std::vector<TextBatch3D::Quad>& TextBatch3D::get_quads(void) const
+{
+    return m_quads;
+}
+void TextBatch3D::clear(void)
+{
+    m_quads.clear();
+}
+void TextBatch3D::flush(void)
+{
+    if (m_quads.empty())
+        return;
+    rlSetTexture(m_font.texture.id);
+    rlBegin(RL_QUADS);
+    for (const auto& quad : m_quads) {
+        rlColor4ub(quad.color.r, quad.color.g, quad.color.b, quad.color.a);
+        for (int i = 0; i < 4; i++) {
+            rlTexCoord2f(quad.texcoords[i].x, quad.texcoords[i].y);
+            rlVertex3f(quad.corners[i].x, quad.corners[i].y, quad.corners[i].z);
         }
-        rlEnd();
     }
-    rlPopMatrix();
+    rlEnd();
     rlSetTexture(0);
-    return { width, height };
+    m_quads.clear();
+}
+
+void TextMesh3D::clear(Font font)
+{
+    m_text.set_font(font);
+}
+Vector2 TextMesh3D::append_codepoint(int codepoint, Vector3 pos, float font_size,
+    const Color& color, bool backface, const Rotation& rotation)
+{
+    return m_text.add_codepoint(codepoint, pos, font_size, color, backface, rotation);
+}
+void TextMesh3D::append_text(const char* txt, Vector3 pos, float font_size, float spacing,
+    const Color& color, bool backface, const Rotation& rotation)
+{
+    m_text.add_text(txt, pos, font_size, spacing, color, backface, rotation);
+}
+size_t TextMesh3D::vertex_count(void) const
+{
+    // two triangles for every quad
+    return m_text.get_quads().size() * 6;
+}
+void TextMesh3D::upload(void)
+{
+    if (m_mesh.vaoId)
+        UnloadMesh(m_mesh);
+    m_mesh = {};
+    if (!m_material.maps)
+        m_material = LoadMaterialDefault();
+    const auto& quads = m_text.get_quads();
+    if (quads.empty())
+        return;
+    m_mesh.vertexCount = vertex_count();
+    m_mesh.triangleCount = m_mesh.vertexCount / 3;
+    m_mesh.vertices = static_cast<float*>(MemAlloc(m_mesh.vertexCount * 3 * sizeof(float)));
+    m_mesh.texcoords = static_cast<float*>(MemAlloc(m_mesh.vertexCount * 2 * sizeof(float)));
+    m_mesh.colors = static_cast<unsigned char*>(MemAlloc(m_mesh.vertexCount * 4));
+    size_t v = 0;
+    for (const auto& quad : quads) {
+        for (const int i : { 0, 1, 2, 0, 2, 3 }) {
+            m_mesh.vertices[v * 3 + 0] = quad.corners[i].x;
+            m_mesh.vertices[v * 3 + 1] = quad.corners[i].y;
+            m_mesh.vertices[v * 3 + 2] = quad.corners[i].z;
+            m_mesh.texcoords[v * 2 + 0] = quad.texcoords[i].x;
+            m_mesh.texcoords[v * 2 + 1] = quad.texcoords[i].y;
+            m_mesh.colors[v * 4 + 0] = quad.color.r;
+            m_mesh.colors[v * 4 + 1] = quad.color.g;
+            m_mesh.colors[v * 4 + 2] = quad.color.b;
+            m_mesh.colors[v * 4 + 3] = quad.color.a;
+            v++;
+        }
+    }
+    UploadMesh(&m_mesh, false);
+    MemFree(m_mesh.vertices);
+    MemFree(m_mesh.texcoords);
+    MemFree(m_mesh.colors);
+    m_mesh.vertices = nullptr;
+    m_mesh.texcoords = nullptr;
+    m_mesh.colors = nullptr;
+}
+void TextMesh3D::draw(size_t count) const
+{
+    if (!m_mesh.vertexCount)
+        return;
+    auto mesh = m_mesh;
+    mesh.vertexCount = std::min<size_t>(count, m_mesh.vertexCount);
+    mesh.triangleCount = mesh.vertexCount / 3;
+    auto& albedo = m_material.maps[MATERIAL_MAP_ALBEDO].texture;
+    const auto default_texture = albedo;
+    albedo = m_text.get_font().texture;
+    DrawMesh(mesh, m_material, MatrixIdentity());
+    albedo = default_texture;
+}
+void TextMesh3D::unload(void)
+{
+    if (m_mesh.vaoId)
+        UnloadMesh(m_mesh);
+    // the albedo texture is the default one again, UnloadMaterial leaves it alone
+    if (m_material.maps)
+        UnloadMaterial(m_material);
+    m_mesh = {};
+    m_material = {};
 }
 } // namespace boot
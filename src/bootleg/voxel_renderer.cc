@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <array>
+#include <bootleg/voxel_renderer.hpp>
+#include <cstddef>
+#include <raymath.h>
+#include <utility>
+#include <rlgl.h>
+
+static const char* VOXEL_VS = R"#(
+#version 330
+in vec3 vertexPosition;
+in vec3 instancePosition;
+in float instanceScale;
+in vec4 instanceColor;
+uniform mat4 mvp;
+out vec4 fragColor;
+void main()
+{
+    fragColor = instanceColor;
+    gl_Position = mvp * vec4(vertexPosition * instanceScale + instancePosition, 1.0);
+}
+)#";
+static const char* MESH_VS = R"#(
+#version 330
+in vec3 vertexPosition;
+in vec4 vertexColor;
+uniform mat4 mvp;
+out vec4 fragColor;
+void main()
+{
+    fragColor = vertexColor;
+    gl_Position = mvp * vec4(vertexPosition, 1.0);
+}
+)#";
+static const char* VOXEL_FS = R"#(
+#version 330
+in vec4 fragColor;
+out vec4 finalColor;
+void main()
+{
+    finalColor = fragColor;
+}
+)#";
+
+// unit cube centered on the origin, two triangles per face
+static constexpr const std::array<float, 36 * 3> CUBE_VERTICES = {
+    // front
+    -.5f, -.5f, .5f, .5f, -.5f, .5f, .5f, .5f, .5f,
+    -.5f, -.5f, .5f, .5f, .5f, .5f, -.5f, .5f, .5f,
+    // back
+    -.5f, -.5f, -.5f, -.5f, .5f, -.5f, .5f, .5f, -.5f,
+    -.5f, -.5f, -.5f, .5f, .5f, -.5f, .5f, -.5f, -.5f,
+    // top
+    -.5f, .5f, -.5f, -.5f, .5f, .5f, .5f, .5f, .5f,
+    -.5f, .5f, -.5f, .5f, .5f, .5f, .5f, .5f, -.5f,
+    // bottom
+    -.5f, -.5f, -.5f, .5f, -.5f, -.5f, .5f, -.5f, .5f,
+    -.5f, -.5f, -.5f, .5f, -.5f, .5f, -.5f, -.5f, .5f,
+    // right
+    .5f, -.5f, -.5f, .5f, .5f, -.5f, .5f, .5f, .5f,
+    .5f, -.5f, -.5f, .5f, .5f, .5f, .5f, -.5f, .5f,
+    // left
+    -.5f, -.5f, -.5f, -.5f, -.5f, .5f, -.5f, .5f, .5f,
+    -.5f, -.5f, -.5f, -.5f, .5f, .5f, -.5f, .5f, -.5f,
+};
+
+namespace boot {
+void VoxelRenderer::init(void)
+{
+    m_shader = LoadShaderFromMemory(VOXEL_VS, VOXEL_FS);
+    m_mvp_loc = GetShaderLocation(m_shader, "mvp");
+    m_position_loc = GetShaderLocationAttrib(m_shader, "instancePosition");
+    m_scale_loc = GetShaderLocationAttrib(m_shader, "instanceScale");
+    m_color_loc = GetShaderLocationAttrib(m_shader, "instanceColor");
+    const int vertex_loc = GetShaderLocationAttrib(m_shader, "vertexPosition");
+
+    m_vao = rlLoadVertexArray();
+    rlEnableVertexArray(m_vao);
+    m_cube_vbo = rlLoadVertexBuffer(CUBE_VERTICES.data(), sizeof(CUBE_VERTICES), false);
+    rlSetVertexAttribute(vertex_loc, 3, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(vertex_loc);
+    rlDisableVertexArray();
+
+    m_mesh_shader = LoadShaderFromMemory(MESH_VS, VOXEL_FS);
+    m_mesh_mvp_loc = GetShaderLocation(m_mesh_shader, "mvp");
+    m_mesh_position_loc = GetShaderLocationAttrib(m_mesh_shader, "vertexPosition");
+    m_mesh_color_loc = GetShaderLocationAttrib(m_mesh_shader, "vertexColor");
+}
+void VoxelRenderer::unload(void)
+{
+    set_chunk_count(0);
+    if (m_mesh_shader.id)
+        UnloadShader(m_mesh_shader);
+    m_mesh_shader = {};
+    if (m_instance_vbo)
+        rlUnloadVertexBuffer(m_instance_vbo);
+    if (m_cube_vbo)
+        rlUnloadVertexBuffer(m_cube_vbo);
+    if (m_vao)
+        rlUnloadVertexArray(m_vao);
+    if (m_shader.id)
+        UnloadShader(m_shader);
+    m_shader = {};
+    m_vao = m_cube_vbo = m_instance_vbo = 0;
+    m_instance_capacity = m_instance_count = 0;
+    m_instance_layer_ends.clear();
+}
+void VoxelRenderer::set_instances(const std::vector<Instance>& instances, std::vector<size_t> layer_ends)
+{
+    m_instance_count = instances.size();
+    m_instance_layer_ends = std::move(layer_ends);
+    if (instances.empty())
+        return;
+    rlEnableVertexArray(m_vao);
+    if (instances.size() > m_instance_capacity) {
+        if (m_instance_vbo)
+            rlUnloadVertexBuffer(m_instance_vbo);
+        m_instance_capacity = std::max(instances.size(), m_instance_capacity * 2);
+        m_instance_vbo = rlLoadVertexBuffer(NULL, m_instance_capacity * sizeof(Instance), true);
+        constexpr const int stride = sizeof(Instance);
+        const auto attribute = [&](int loc, int size, int type, bool normalized, size_t offset) {
+            if (loc < 0)
+                return;
+            rlSetVertexAttribute(loc, size, type, normalized, stride, offset);
+            rlSetVertexAttributeDivisor(loc, 1);
+            rlEnableVertexAttribute(loc);
+        };
+        attribute(m_position_loc, 3, RL_FLOAT, false, offsetof(Instance, position));
+        attribute(m_scale_loc, 1, RL_FLOAT, false, offsetof(Instance, scale));
+        attribute(m_color_loc, 4, RL_UNSIGNED_BYTE, true, offsetof(Instance, color));
+    }
+    rlUpdateVertexBuffer(m_instance_vbo, instances.data(), instances.size() * sizeof(Instance), 0);
+    rlDisableVertexArray();
+}
+size_t VoxelRenderer::get_instance_count(void) const
+{
+    return m_instance_count;
+}
+void VoxelRenderer::unload_chunk(Chunk& chunk)
+{
+    if (chunk.position_vbo)
+        rlUnloadVertexBuffer(chunk.position_vbo);
+    if (chunk.color_vbo)
+        rlUnloadVertexBuffer(chunk.color_vbo);
+    if (chunk.vao)
+        rlUnloadVertexArray(chunk.vao);
+    m_mesh_vertex_count -= chunk.vertex_count;
+    chunk = {};
+}
+void VoxelRenderer::set_chunk_count(size_t count)
+{
+    for (auto& chunk : m_chunks)
+        unload_chunk(chunk);
+    m_chunks.assign(count, Chunk {});
+    m_mesh_vertex_count = 0;
+}
+size_t VoxelRenderer::get_chunk_count(void) const
+{
+    return m_chunks.size();
+}
+void VoxelRenderer::set_chunk_mesh(size_t chunk, const VoxelMeshData& data)
+{
+    auto& c = m_chunks[chunk];
+    unload_chunk(c);
+    if (!data.vertex_count())
+        return;
+    c.vertex_count = data.vertex_count();
+    c.first_layer = data.first_layer;
+    c.layer_ends = data.layer_ends;
+    c.caps = data.caps;
+    c.vao = rlLoadVertexArray();
+    rlEnableVertexArray(c.vao);
+    c.position_vbo = rlLoadVertexBuffer(data.vertices.data(), data.vertices.size() * sizeof(float), false);
+    rlSetVertexAttribute(m_mesh_position_loc, 3, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(m_mesh_position_loc);
+    c.color_vbo = rlLoadVertexBuffer(data.colors.data(), data.colors.size(), false);
+    rlSetVertexAttribute(m_mesh_color_loc, 4, RL_UNSIGNED_BYTE, true, 0, 0);
+    rlEnableVertexAttribute(m_mesh_color_loc);
+    rlDisableVertexArray();
+    m_mesh_vertex_count += c.vertex_count;
+}
+size_t VoxelRenderer::get_mesh_vertex_count(void) const
+{
+    return m_mesh_vertex_count;
+}
+void VoxelRenderer::draw(int layer) const
+{
+    if ((!m_instance_count && !m_mesh_vertex_count) || layer <= 0)
+        return;
+    // whatever raylib batched so far has to be drawn first to keep the draw order
+    rlDrawRenderBatchActive();
+    const auto mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    if (m_mesh_vertex_count) {
+        rlEnableShader(m_mesh_shader.id);
+        rlSetUniformMatrix(m_mesh_mvp_loc, mvp);
+        for (const auto& chunk : m_chunks) {
+            const int layers = std::clamp<int>(layer - chunk.first_layer, 0, chunk.layer_ends.size());
+            if (!chunk.vertex_count || !layers)
+                continue;
+            rlEnableVertexArray(chunk.vao);
+            rlDrawVertexArray(0, chunk.layer_ends[layers - 1]);
+            // the cut goes right through this chunk, the tops of its last layer are open
+            if (layer - chunk.first_layer == layers) {
+                const auto& cap = chunk.caps[layers - 1];
+                if (cap.end > cap.start)
+                    rlDrawVertexArray(cap.start, cap.end - cap.start);
+            }
+        }
+        rlDisableVertexArray();
+    }
+    const size_t instances = m_instance_layer_ends.empty()
+        ? m_instance_count
+        : m_instance_layer_ends[std::min<size_t>(layer, m_instance_layer_ends.size()) - 1];
+    if (instances) {
+        rlEnableShader(m_shader.id);
+        rlSetUniformMatrix(m_mvp_loc, mvp);
+        rlEnableVertexArray(m_vao);
+        rlDrawVertexArrayInstanced(0, CUBE_VERTICES.size() / 3, instances);
+        rlDisableVertexArray();
+    }
+    rlDisableShader();
+}
+}
@@ -2,10 +2,45 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <limits>
 #include <utf8.hpp>
 
 namespace bed {
 
+static bool same_color(Color a, Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+TextBuffer::syntax_data_t::syntax_data_t(std::vector<SyntaxSpan>& spans, long line)
+    : m_spans(&spans)
+    , m_line(line)
+{
+}
+void TextBuffer::syntax_data_t::append(Cursor pos, Color color)
+{
+    if (pos.line != m_line)
+        return;
+    auto& spans = *m_spans;
+    if (!spans.empty() && pos.col < spans.back().col) {
+        // out of order, not what the parsers do but keep the spans sorted anyway
+        const auto it = std::partition_point(spans.begin(), spans.end(),
+            [&](const SyntaxSpan& span) { return span.col < pos.col; });
+        if (it != spans.end() && it->col == pos.col)
+            it->color = color;
+        else
+            spans.insert(it, { pos.col, color });
+        return;
+    }
+    if (!spans.empty() && pos.col == spans.back().col) {
+        spans.back().color = color;
+        if (spans.size() > 1 && same_color(spans[spans.size() - 2].color, color))
+            spans.pop_back();
+        return;
+    }
+    if (!spans.empty() && same_color(spans.back().color, color))
+        return;
+    spans.push_back({ pos.col, color });
+}
 TextBuffer::TextBuffer(Font f, Rectangle bounds)
     : m_font { f }
     , m_bounds { bounds }
@@ -189,6 +224,7 @@ void TextBuffer::delete_selection(void)
         m_cursor.col = start.col;
         auto& start_line = m_lines[start.line];
         start_line.contents.erase(start_line.contents.begin() + start.col, start_line.contents.begin() + end.col);
+        measure_line(start.line);
     } else {
         m_cursor = start;
         auto& start_line = m_lines[start.line].contents;
@@ -436,9 +472,11 @@ void TextBuffer::delete_lines(size_t start, size_t end)
 {
     if (m_lines.size() == 1) {
         m_lines[0].contents.erase();
+        measure_line(std::size_t { 0 });
         return;
     }
-    m_lines.erase(m_lines.begin() + start, m_lines.begin() + end + 1);
+    m_lines.erase(start, end + 1);
+    lines_erased(start, end + 1);
     clamp_cursor();
     // update_total_height();
     // update_viewport_to_cursor();
@@ -449,11 +487,12 @@ void TextBuffer::clear(void)
 {
     m_lines.clear();
     m_lines.push_back({});
+    m_syntax_dirty_begin = 0;
+    m_syntax_dirty_end = 1;
     m_cursor = {};
     measure_lines();
     update_total_height();
     update_viewport_to_cursor();
-    m_syntax_data.clear();
 }
 bool TextBuffer::_concat(ConcatDir dir)
 {
@@ -480,7 +519,7 @@ bool TextBuffer::_concat(ConcatDir dir)
     // update_scroll_h();
     // update_syntax();
     m_do_common_updates = true;
-    measure_line(m_lines[m_cursor.line]);
+    measure_line(m_cursor.line);
     return ret;
 }
 bool TextBuffer::concat_backward(void)
@@ -523,7 +562,7 @@ void TextBuffer::_delete_characters(DeleteDir dir, unsigned long amount)
     // update_scroll_h();
     // update_syntax();
     m_do_common_updates = true;
-    measure_line(m_lines[m_cursor.line]);
+    measure_line(m_cursor.line);
 }
 void TextBuffer::delete_characters_back(unsigned long amount)
 {
@@ -565,7 +604,7 @@ void TextBuffer::_delete_words(DeleteDir dir, unsigned long amount)
     // update_syntax();
     m_do_common_updates = true;
     // update_scroll_v(0);
-    measure_line(m_lines[m_cursor.line]);
+    measure_line(m_cursor.line);
 }
 void TextBuffer::delete_words_back(unsigned long amount)
 {
@@ -580,35 +619,47 @@ void TextBuffer::insert_character(char_t c)
     current_line().push_back('!');
     std::shift_right(current_line().begin() + m_cursor.col, current_line().end(), 1);
     current_line()[m_cursor.col++] = static_cast<char_t>(c);
-    measure_line(m_lines[m_cursor.line]);
+    measure_line(m_cursor.line);
     m_do_common_updates = true;
     // update_scroll_h();
     // update_syntax();
 }
 void TextBuffer::insert_string(line_t&& str)
 {
-    std::string line = {};
-    auto start = m_cursor.line;
+    std::vector<Line> lines = { {} };
     for (const auto c : str) {
         if (c == '\n') {
-            current_line().insert(m_cursor.col, line);
-            m_cursor.col += line.length();
-            insert_newline();
-            line = {};
+            lines.push_back({});
         } else if (c == '\r') {
             continue;
         } else if (c == '\t') {
-            line.append("    ");
+            lines.back().contents.append("    ");
         } else {
-            line.push_back(c);
+            lines.back().contents.push_back(c);
         }
     }
-    current_line().insert(m_cursor.col, line);
-    m_cursor.col += line.length();
+    auto start = m_cursor.line;
+    if (lines.size() == 1) {
+        current_line().insert(m_cursor.col, lines.front().contents);
+        m_cursor.col += lines.front().contents.length();
+    } else {
+        // the rest of the current line ends up behind the last inserted line
+        auto& line = current_line();
+        auto rest = line.substr(m_cursor.col);
+        line.erase(m_cursor.col);
+        line.append(lines.front().contents);
+        const long col = lines.back().contents.length();
+        lines.back().contents.append(rest);
+        m_lines.insert(m_cursor.line + 1,
+            std::make_move_iterator(lines.begin() + 1), std::make_move_iterator(lines.end()));
+        lines_inserted(m_cursor.line + 1, lines.size() - 1);
+        m_cursor.line += lines.size() - 1;
+        m_cursor.col = col;
+    }
 
     auto end = m_cursor.line;
     for (auto i = start; i <= end; i++) {
-        measure_line(m_lines[i]);
+        measure_line(i);
     }
     // update_total_height();
     // update_viewport_to_cursor();
@@ -622,9 +673,9 @@ void TextBuffer::insert_line(line_t&& str)
     m_cursor.col += len;
     update_total_height();
     update_viewport_to_cursor();
-    measure_line(m_lines[m_cursor.line]);
+    measure_line(m_cursor.line);
     insert_newline();
-    measure_line(m_lines[m_cursor.line]);
+    measure_line(m_cursor.line);
     update_syntax();
 }
 void TextBuffer::jump_cursor_to_top(bool with_selection)
@@ -649,28 +700,26 @@ void TextBuffer::jump_cursor_to_start(bool with_selection)
 }
 void TextBuffer::insert_newline(void)
 {
-    m_lines.resize(m_lines.size() + 1);
-    std::shift_right(m_lines.begin() + m_cursor.line + 1, m_lines.end(), 1);
-    m_lines.insert(m_lines.begin() + m_cursor.line + 1, {});
-    auto& next_line = m_lines[m_cursor.line + 1].contents;
+    Line next_line = {};
     if (m_cursor.col < (long)current_line().size()) {
-        next_line.resize(current_line().size() - m_cursor.col);
-        std::copy(current_line().begin() + m_cursor.col, current_line().end(), next_line.begin());
+        next_line.contents.assign(current_line().begin() + m_cursor.col, current_line().end());
         current_line().erase(current_line().begin() + m_cursor.col, current_line().end());
-        measure_line(m_lines[m_cursor.line]);
+        measure_line(m_cursor.line);
     }
+    m_lines.insert(m_cursor.line + 1, std::move(next_line));
+    lines_inserted(m_cursor.line + 1, 1);
     m_cursor.line++;
     m_cursor.col = 0;
     // update_total_height();
     // update_viewport_to_cursor();
     // update_syntax();
     m_do_common_updates = true;
-    measure_line(m_lines[m_cursor.line]);
+    measure_line(m_cursor.line);
 }
 /// this function ensures that the viewport contains the cursor (the cursor is visible on the screen)
 void TextBuffer::update_viewport_to_cursor(void)
 {
-    const auto current_line_pos = f_line_advance * m_cursor.line;
+    const auto current_line_pos = line_y(m_cursor.line);
     if (current_line_pos >= m_bounds.height + m_scroll_v || current_line_pos < m_scroll_v) {
         update_scroll_v(current_line_pos - (m_bounds.height + m_scroll_v - f_line_advance));
     }
@@ -694,9 +743,55 @@ float TextBuffer::get_glyph_width(const Font& font, int codepoint) const
 }
 void TextBuffer::update_syntax(void)
 {
-    m_syntax_data.clear();
-    if (m_syntax_parse_fn)
-        m_syntax_parse_fn(m_syntax_data, this->begin(), this->end());
+    const auto begin = std::min(m_syntax_dirty_begin, m_lines.size());
+    const auto end = std::min(m_syntax_dirty_end, m_lines.size());
+    m_syntax_dirty_begin = m_syntax_dirty_end = 0;
+    if (!m_syntax_parse_fn || begin >= end)
+        return;
+    syntax_state_t state = begin > 0 ? m_lines[begin - 1].syntax_state : syntax_state_t {};
+    for (auto linen = begin; linen < m_lines.size(); linen++) {
+        auto& line = m_lines[linen];
+        line.syntax.clear();
+        syntax_data_t syntax = { line.syntax, static_cast<long>(linen) };
+        state = m_syntax_parse_fn(syntax, state, create_line_iterator(linen), create_line_iterator(linen + 1));
+        // the lines below only depend on this one through its state
+        const bool converged = linen + 1 >= end && state == line.syntax_state;
+        line.syntax_state = state;
+        if (converged)
+            break;
+    }
+}
+void TextBuffer::mark_syntax_dirty(std::size_t first, std::size_t last)
+{
+    if (m_syntax_dirty_begin >= m_syntax_dirty_end) {
+        m_syntax_dirty_begin = first;
+        m_syntax_dirty_end = last;
+        return;
+    }
+    m_syntax_dirty_begin = std::min(m_syntax_dirty_begin, first);
+    m_syntax_dirty_end = std::max(m_syntax_dirty_end, last);
+}
+void TextBuffer::lines_inserted(std::size_t at, std::size_t count)
+{
+    if (m_syntax_dirty_begin < m_syntax_dirty_end) {
+        if (m_syntax_dirty_begin >= at)
+            m_syntax_dirty_begin += count;
+        if (m_syntax_dirty_end > at)
+            m_syntax_dirty_end += count;
+    }
+    // the line below the new ones was parsed with the state of a different line above it
+    mark_syntax_dirty(at, at + count + 1);
+}
+void TextBuffer::lines_erased(std::size_t first, std::size_t last)
+{
+    if (m_syntax_dirty_begin < m_syntax_dirty_end) {
+        const auto shift = [&](std::size_t line) {
+            return line >= last ? line - (last - first) : std::min(line, first);
+        };
+        m_syntax_dirty_begin = shift(m_syntax_dirty_begin);
+        m_syntax_dirty_end = shift(m_syntax_dirty_end);
+    }
+    mark_syntax_dirty(first, first + 1);
 }
 float TextBuffer::measure_line_till_cursor(void)
 {
@@ -734,6 +829,11 @@ void TextBuffer::measure_line(Line& line)
     dims.x = width_max;
     line.dims = dims;
 }
+void TextBuffer::measure_line(std::size_t line)
+{
+    m_lines.update(line, [&](Line& line_data) { measure_line(line_data); });
+    mark_syntax_dirty(line, line + 1);
+}
 void TextBuffer::measure_lines(void)
 {
     f_total_width = 0.0;
@@ -742,6 +842,36 @@ void TextBuffer::measure_lines(void)
         if (line_data.dims->x > f_total_width)
             f_total_width = line_data.dims->x;
     }
+    m_lines.reweigh();
+}
+float TextBuffer::line_y(std::size_t line) const
+{
+    if (!m_wrap_lines)
+        return line * f_line_advance;
+    return m_lines.prefix_weight(line) * f_line_advance;
+}
+std::pair<std::size_t, float> TextBuffer::line_at_y(float y) const
+{
+    if (f_line_advance <= 0 || y <= 0)
+        return { 0, 0 };
+    const auto row = static_cast<long>(y / f_line_advance);
+    // every line is at least one row high so the row falls into exactly one line
+    const auto line = std::min(m_wrap_lines ? m_lines.upper_bound_weight(row) : static_cast<std::size_t>(row),
+        get_line_count() - 1);
+    return { line, line_y(line) };
+}
+Color TextBuffer::syntax_color_before(Cursor pos) const
+{
+    // the color of a syntax entry lasts until the next one, so look for the closest one before
+    for (long line = pos.line; line >= 0; line--) {
+        const auto& syntax = m_lines[line].syntax;
+        const long end = line == pos.line ? pos.col : std::numeric_limits<long>::max();
+        const auto it = std::partition_point(syntax.begin(), syntax.end(),
+            [&](const SyntaxSpan& span) { return span.col < end; });
+        if (it != syntax.begin())
+            return std::prev(it)->color;
+    }
+    return foreground_color;
 }
 void TextBuffer::draw(void)
 {
@@ -749,10 +879,14 @@ void TextBuffer::draw(void)
     DrawRectangleRec(m_bounds, background_color);
     // for selection checking
     TextBuffer::Cursor _cursor = {};
-    Vector2 pos = { m_bounds.x - (m_wrap_lines ? 0 : m_scroll_h), m_bounds.y - m_scroll_v };
-    Color fc = foreground_color;
-    for (std::size_t linen = 0; linen < get_line_count(); linen++) {
+    // only the lines inside the viewport get drawn
+    const auto [first_line, first_line_y] = line_at_y(m_scroll_v);
+    const float bottom = m_bounds.y + m_bounds.height;
+    Vector2 pos = { m_bounds.x - (m_wrap_lines ? 0 : m_scroll_h), m_bounds.y - m_scroll_v + first_line_y };
+    Color fc = m_syntax_parse_fn ? syntax_color_before({ static_cast<long>(first_line), 0 }) : foreground_color;
+    for (std::size_t linen = first_line; linen < get_line_count() && pos.y < bottom; linen++) {
         auto& current_line = m_lines[linen];
+        std::size_t span = 0;
         for (size_t col = 0; col < current_line.contents.size();) {
             int csz = 1;
             int c = GetCodepoint((char*)&current_line.contents.data()[col], &csz);
@@ -777,10 +911,9 @@ void TextBuffer::draw(void)
                 };
                 DrawRectangleRec(cursor_line, foreground_color);
             }
-            const auto current_cursor = Cursor { static_cast<long>(linen), static_cast<long>(col) };
-            if (m_syntax_parse_fn && m_syntax_data.contains(current_cursor)) {
-                fc = m_syntax_data[current_cursor];
-            }
+            // the spans are sorted so they get picked up in order
+            for (; m_syntax_parse_fn && span < current_line.syntax.size() && current_line.syntax[span].col <= (long)col; span++)
+                fc = current_line.syntax[span].color;
             _cursor.col = col + 1;
             _cursor.line = linen;
             if (get_selection().has_value() && get_selection()->is_cursor_within(_cursor) && !skip_draws) {
@@ -987,17 +1120,21 @@ void TextBuffer::update_buffer(void)
             insert_character(utfbuf[i]);
         }
     }
-    if (m_do_common_updates) {
-        m_do_common_updates = false;
-        update_total_height();
-        update_viewport_to_cursor();
-        update_scroll_h();
-        update_syntax();
-        update_scroll_v(0);
-    }
+    update_after_edits();
     if (start_pos != m_cursor && !shift_down)
         clear_selection();
 }
+void TextBuffer::update_after_edits(void)
+{
+    if (!m_do_common_updates)
+        return;
+    m_do_common_updates = false;
+    update_total_height();
+    update_viewport_to_cursor();
+    update_scroll_h();
+    update_syntax();
+    update_scroll_v(0);
+}
 
 void TextBuffer::update_scroll_h(void)
 {
@@ -1011,12 +1148,8 @@ void TextBuffer::update_total_height(void)
 {
     if(!m_wrap_lines)
         f_total_height = f_line_advance * m_lines.size();
-    else {
-        f_total_height = 0;
-        for(const auto& l : m_lines){
-            f_total_height += l.lines_when_wrapped * f_line_advance;
-        }
-    }
+    else
+        f_total_height = m_lines.total_weight() * f_line_advance;
     if (f_total_height <= m_bounds.height)
         m_scroll_v = 0;
 }
@@ -1041,18 +1174,9 @@ std::optional<TextBuffer::Cursor> TextBuffer::mouse_as_cursor_position(Vector2 p
         return std::nullopt;
     long linenum = 0;
     if (m_wrap_lines) {
-        point.y -= m_scroll_v;
-        auto last_line_end = -m_scroll_v;
-        for (auto i = 0; i < (long)get_line_count(); i++) {
-            auto this_line_end = last_line_end + (m_lines[i].lines_when_wrapped * f_line_advance);
-            if (point.y <= this_line_end) {
-                break;
-            }
-            last_line_end = this_line_end;
-            linenum++;
-        }
-        linenum = linenum >= (int)get_line_count() ? get_line_count() - 1 : linenum;
-        int y_in_line = (point.y - last_line_end) / f_line_advance;
+        const auto [line, line_top] = line_at_y(point.y);
+        linenum = line;
+        int y_in_line = (point.y - line_top) / f_line_advance;
         point.y = y_in_line;
     } else {
         linenum = point.y == 0 ? 0 : (long)(point.y / f_line_advance) % get_line_count();
@@ -1097,6 +1221,10 @@ TextBuffer::text_buffer_iterator TextBuffer::create_begin_iterator(void) const
 {
     return text_buffer_iterator(&m_lines);
 }
+TextBuffer::text_buffer_iterator TextBuffer::create_line_iterator(std::size_t line) const
+{
+    return text_buffer_iterator::at_line(&m_lines, line);
+}
 TextBuffer::text_buffer_iterator TextBuffer::create_end_iterator(void) const
 {
     return text_buffer_iterator::end(&m_lines);
@@ -1112,5 +1240,6 @@ TextBuffer::text_buffer_iterator TextBuffer::end(void) const
 void TextBuffer::set_syntax_parser(process_syntax_fn fn)
 {
     m_syntax_parse_fn = fn;
+    mark_syntax_dirty(0, m_lines.size());
 }
 }
@@ -2,23 +2,34 @@
 #include <iostream>
 namespace bed {
 using tit = TextBuffer::text_buffer_iterator;
-tit::text_buffer_iterator(const std::vector<TextBuffer::Line>* lines)
+tit::text_buffer_iterator(const TextBuffer::lines_t* lines)
     : m_lines(lines)
+    , m_current_line(&(*lines)[0])
     , m_sz(lines->size())
-    , m_current_line_len((*m_lines)[m_line].contents.size())
+    , m_current_line_len(m_current_line->contents.size())
     {};
-tit tit::end(const std::vector<TextBuffer::Line>* lines)
+tit tit::end(const TextBuffer::lines_t* lines)
 {
     auto t = text_buffer_iterator(lines);
     t.m_line = t.m_sz;
     return t;
 }
+tit tit::at_line(const TextBuffer::lines_t* lines, std::size_t line)
+{
+    auto t = text_buffer_iterator(lines);
+    t.m_line = line;
+    if (line < t.m_sz) {
+        t.m_current_line = &(*lines)[line];
+        t.m_current_line_len = t.m_current_line->contents.size();
+    }
+    return t;
+}
 TextBuffer::char_t tit::operator*() const
 {
     if (m_col == m_current_line_len) {
         return '\n';
     }
-    return (*m_lines)[m_line].contents[m_col];
+    return m_current_line->contents[m_col];
 }
 void tit::operator++()
 {
@@ -28,8 +39,10 @@ void tit::operator++()
     if (m_col > m_current_line_len) {
         m_line++;
         m_col = 0;
-        if (m_line < m_sz)
-            m_current_line_len = (*m_lines)[m_line].contents.size();
+        if (m_line < m_sz) {
+            m_current_line = &(*m_lines)[m_line];
+            m_current_line_len = m_current_line->contents.size();
+        }
     }
 }
 void tit::operator++(int)